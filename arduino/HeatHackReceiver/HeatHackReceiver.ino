@@ -4,13 +4,73 @@
 // make rfm69 radio operate in rf12 mode
 #define RF69_COMPAT 1
 
+// or use the rfm69's own packet format, which keeps the radio and processor busy
+// for much less time per packet. Every radio in the group has to use the same, so
+// the nodes need rfm69s too.
+//#define RF69_NATIVE 1
+
+// only accept secured readings from the nodes. See HeatHackSecure.h.
+//#define SECURE true
+
+// move the group to another channel when something else is using this one. Every
+// radio in the group has to use it. See HeatHackChannel.h.
+//#define CHANNEL_PLAN true
+
+// give nodes with a strong signal a faster data rate. See HeatHackRate.h.
+//#define ADAPTIVE_RATE true
+
 #include <JeeLib.h>
 #include <OneWire.h>
+#include <PinChange.h>
 #include <HeatHack.h>
 #include <HeatHackShared.h>
+#include <HeatHackNodeTable.h>
+
+// how often the statistics are printed when FLAG_STATS is set
+#define STATS_INTERVAL_SECS 600
+
+// statistics for the receiver. There's no room to keep them for each node, so
+// each node's lost packets and signal strength go out with its readings for the hub
+// to add up. Packets with a CRC error can't be put down to a node, as their header
+// may be the part that's corrupt.
+uint32_t crcErrors = 0;
+uint32_t duplicates = 0;
+uint32_t acksSent = 0;
+uint32_t serialStalls = 0;    // reports that didn't fit in the serial port's transmit buffer
+
+#if SECURE
+// secured packets that failed their check, and old ones sent again
+uint32_t authFailures = 0;
+uint32_t replays = 0;
+
+// what openSecured found
+#define OPENED_DATA 0  // genuine and new, and now decrypted
+#define OPENED_TEST 1  // an unsecured test packet, to ack but not report
+#define OPENED_DROP 2  // forged, replayed or a copy of one already handled
+#endif
+
+#if CHANNEL_PLAN
+// how busy each channel is, in 256ths, averaged over the surveys (see HeatHackChannel.h)
+byte channelNoise[CHANNEL_COUNT];
+
+// new packets and lost ones on the group's channel since it was last checked
+uint16_t channelPackets = 0;
+uint16_t channelMissed = 0;
+
+// when a packet was last heard, for a secondary receiver to find the group
+uint32_t channelLastHeard = 0;
+#endif
 
-// holds last seen sequence number for each node
-byte lastSequence[30];
+// signal strength of the packet being handled, 0 if not known
+byte packetRssi = 0;
+
+#if ADAPTIVE_RATE
+// data rate step of the packet being handled
+byte packetStep = 0;
+#endif
+
+// node to ask for its event trace in the next ack, 0 for none
+uint16_t traceNode = 0;
 
 /////////////////////////////////////////////////////////////////////
 void setup() {
@@ -39,139 +99,611 @@ void setup() {
   Serial.println();  
   Serial.flush();
   
-  // initialise transceiver
-  rf12_initialize(RECEIVER_NODE_ID, RF12_868MHZ, myGroupID);
+  // initialise transceiver. A secondary receiver uses the extended node RF12 id to hear
+  // the main receiver's acks to every node, which carry its clock.
+  rf12_initialize((eepromFlags & FLAG_ACK) ? RECEIVER_NODE_ID : EXT_RF12_NODE_ID, RF12_868MHZ, myGroupID);
   
-  // init lastSequences to unused values
-  for (byte i=0; i<30; i++) {
-    lastSequence[i] = 0xff;
-  }
 }
 
 
 /////////////////////////////////////////////////////////////////////
 void loop() {
-  if (rf12_recvDone() && rf12_crc == 0) {
-    // valid data received
-    
+  // t<node> asks the node for its event trace. See HeatHackTrace.h.
+  // s prints the statistics.
+  static char command[6];
+  if (readline(command, sizeof(command)) > 0) {
+    if (command[0] == 't') {
+      traceNode = parseInt(&command[1], NODE_MIN, EXT_NODE_MAX);
+      Serial.println();
+    }
+    else if (command[0] == 's') {
+      printStats();
+    }
+  }
+
+  if (rf12_recvDone()) {
+    if (rf12_crc == 0) {
+#if CHANNEL_PLAN
+      channelLastHeard = millis();
+#endif
+      receivePacket();
+    }
+    else {
+      crcErrors++;
+    }
+  }
+
+#if CHANNEL_PLAN
+  updateChannel();
+#endif
+
+#if ADAPTIVE_RATE
+  // listen at each faster step in its window
+  byte step = rateWindow();
+  if (step != rateTuned && radioCanRetune()) setRate(step);
+#endif
+
+  static uint32_t lastStats = 0;
+  if ((eepromFlags & FLAG_STATS) && millis() - lastStats >= STATS_INTERVAL_SECS * 1000UL) {
+    lastStats = millis();
+    printStats();
+  }
+}
+
+/////////////////////////////////////////////////////////////////////
+// handle a packet received with a valid CRC
+void receivePacket(void) {
+#if RF69_COMPAT
+  packetRssi = RF69::rssi;
+#endif
+#if ADAPTIVE_RATE
+  packetStep = rateTuned;
+#endif
+
+  if (rf12_hdr & RF12_HDR_CTL) {
+    // an ack from another receiver or a repeater. An ack to an extended node starts
+    // with the node's id.
+#if TIME_SYNC
+    // and its channel moves
+    if (!(eepromFlags & FLAG_ACK)) readAckData((rf12_hdr & RF12_HDR_DST) ? 0 : 2);
+#endif
+    return;
+  }
+
+  // take a copy as sending the ack overwrites the receive buffer
+  byte packet[RF12_MAXDATA];
+  byte len = rf12_len;
+  memcpy(packet, (const void*) rf12_data, len);
+
+  uint16_t node;
+  HeatHackData *data;
+
+  // packets from a repeater hold data from other nodes instead
+  bool isRepeated = false;
+
+  if (rf12_hdr & RF12_HDR_DST) {
+    // sent directly to the receiver, so the sender's id is in an HHExtHeader
+    if ((rf12_hdr & RF12_HDR_MASK) != RECEIVER_NODE_ID || len < sizeof(HHExtHeader)) return;
+    HHExtHeader *header = (HHExtHeader *)packet;
+
+    if (header->kind == HH_PACKET_TRACE) {
+      tracePrint(header->nodeId, (const TraceEvent*) &packet[sizeof(HHExtHeader)], (len - sizeof(HHExtHeader)) / sizeof(TraceEvent));
+      return;
+    }
+    if (header->kind == HH_PACKET_REPEATED) isRepeated = true;
+    else if (header->kind != HH_PACKET_DATA) return;
+
+    node = header->nodeId;
+    data = (HeatHackData *)&packet[sizeof(HHExtHeader)];
+  }
+  else {
     // get node id from packet header
-    byte node = rf12_hdr & RF12_HDR_MASK;
+    node = rf12_hdr & RF12_HDR_MASK;
+    data = (HeatHackData *)packet;
+  }
+
+  // a secure receiver only acks and reports data it's checked. A repeater's packet
+  // isn't secured itself, the node data in it is.
+  bool report = true;
+#if SECURE
+  if (!isRepeated) {
+    byte opened = openSecured(node, data, len - ((byte *)data - packet));
+    if (opened == OPENED_DROP) return;
+    report = opened == OPENED_DATA;
+  }
+#endif
+
+  bool sentAck = false;
 
-    bool sentAck = false;
+  if (eepromFlags & FLAG_ACK) {
+    // send ack immediately to avoid delays caused by time taken to write to serial port
+    if(RF12_WANTS_ACK){
+      byte ack[16];
+      byte ackLen = 0;
 
-    if (eepromFlags & FLAG_ACK) {
-      // send ack immediately to avoid delays caused by time taken to write to serial port
-      if(RF12_WANTS_ACK){
-        rf12_sendStart(RF12_ACK_REPLY, 0, 0);
-        rf12_sendWait(1);
-        
-        sentAck = true;
+      // an ack to an extended node is broadcast so it starts with the node's id
+      if (rf12_hdr & RF12_HDR_DST) {
+        ack[ackLen++] = node & 0xFF;
+        ack[ackLen++] = node >> 8;
       }
-    }
-    
-    // packet data is a HeatHackData struct
-    HeatHackData *data = (HeatHackData *)rf12_data;
-    
-    // check sequence number. If same as last one we saw for this node
-    // then data is resent so ignore it.
-    bool isRepeat = false;
-    
-    if (data->sequence != lastSequence[node-1]) {
-      lastSequence[node-1] = data->sequence;
 
-      // don't report test readings as they're just for testing the connection between transmitter and receiver
-      if (! (data->numReadings == 1 && data->readings[0].sensorType == HHSensorType::TEST)) {
+      // the receiver's clock, for the node to timestamp its readings with
+      uint32_t now = millis();
+      ack[ackLen++] = ACK_TIME_SYNC;
+      memcpy(&ack[ackLen], &now, sizeof(now));
+      ackLen += sizeof(now);
+
+#if CHANNEL_PLAN
+      ackLen += addChannelAck(&ack[ackLen]);
+#endif
+
+#if ADAPTIVE_RATE
+      // the step for the node's next packet, which a repeater's packet doesn't need.
+      // Only checked data may add a node to the table, as it can take another's slot.
+      if (!isRepeated) {
+        byte slot;
+        byte step = 0;
+        if (report) step = nodeTable[findNode(node)].rateStep;
+        else if (lookupNode(node, slot)) step = nodeTable[slot].rateStep;
+
+        ack[ackLen++] = ACK_RATE;
+        ack[ackLen++] = step;
+      }
+#endif
 
-        reportReadings(node, data);
+      if (node == traceNode) {
+        ack[ackLen++] = ACK_TRACE_REQUEST;
+        traceNode = 0;
       }
+
+      rf12_sendStart(RF12_ACK_REPLY, ack, ackLen);
+      rf12_sendWait(1);
       
-      // flash LED to indicate packet received
-      flashLED();
+      sentAck = true;
+      acksSent++;
     }
-    else {
-      isRepeat = true;
+  }
+
+  if (isRepeated) {
+    // a HHRepeatedHeader then the HeatHackData for each node
+    byte pos = sizeof(HHExtHeader);
+
+    while (pos + sizeof(HHRepeatedHeader) < len) {
+      HHRepeatedHeader *entry = (HHRepeatedHeader *)&packet[pos];
+      pos += sizeof(HHRepeatedHeader);
+      if (entry->size == 0 || pos + entry->size > len) break;
+
+      HeatHackData *entryData = (HeatHackData *)&packet[pos];
+#if SECURE
+      report = openSecured(entry->nodeId, entryData, entry->size) == OPENED_DATA;
+#endif
+      if (report) handleData(entry->nodeId, entryData, node, entry->hops);
+      pos += entry->size;
+    }
+  }
+  else if (report) {
+    handleData(node, data, 0, 0);
+  }
+
+  if ((eepromFlags & FLAG_VERBOSE) && sentAck) {
+    Serial.println(F("Sent ack"));
+    Serial.println();
+  }
+}
+
+/////////////////////////////////////////////////////////////////////
+// report a node's data unless it's a resend. via is the repeater that passed it on
+// with the number of repeaters in hops, or 0 if it came straight from the node.
+void handleData(uint16_t node, HeatHackData *data, uint16_t via, byte hops) {
+  int16_t age = takeSampleAge(data);
+
+  // check sequence number. If same as last one we saw for this node
+  // then data is resent so ignore it.
+  bool isRepeat = false;
+  byte slot = findNode(node);
+  NodeEntry *entry = &nodeTable[slot];
+
+  byte missed = 0;
+
+  if (data->sequence != entry->lastSequence) {
+    missed = countMissed(slot, data->sequence);
+    entry->lastSequence = data->sequence;
+
+    // don't report test readings as they're just for testing the connection between transmitter and receiver
+    if (! (data->numReadings == 1 && data->readings[0].sensorType == HHSensorType::TEST)) {
+
+      reportReadings(node, data, age, missed);
+    }
+    
+    // flash LED to indicate packet received
+    flashLED();
+  }
+  else {
+    isRepeat = true;
+    duplicates++;
+  }
+
+#if ADAPTIVE_RATE
+  // the rate's only for the link to the receiver. A packet is clean if it's the
+  // first try and none have been lost since the last.
+  if (!via) adaptRate(slot, !isRepeat && missed == 0);
+#endif
+
+  if (eepromFlags & FLAG_VERBOSE) {
+    Serial.print(F("\n\rData from node "));
+    Serial.print(node);
+    Serial.print(F(" seq "));
+    Serial.print(data->sequence);
+
+    if (via) {
+      Serial.print(F(" via repeater "));
+      Serial.print(via);
+      Serial.print(F(" ("));
+      Serial.print(hops);
+      Serial.print(F(" hops)"));
     }
 
-    if (eepromFlags & FLAG_VERBOSE) {
-      Serial.print(F("\n\rData from node "));
-      Serial.print(node);
-      Serial.print(F(" seq "));
-      Serial.print(data->sequence);
+    if (age >= 0) {
+      Serial.print(F(" taken "));
+      Serial.print(age);
+      Serial.print(F("s ago"));
+    }
+
+    if (isRepeat) {        
+      Serial.print(F(" (repeated sequence id)"));
+    }
+#if ADAPTIVE_RATE
+    if (!via) {
+      Serial.print(F(" rate "));
+      Serial.print(entry->rateStep);
+    }
+#endif
+    Serial.println();
+    
+    for (byte i=0; i<data->numReadings; i++) {
+      uint8_t sensorType = data->readings[i].sensorType;
+
+      Serial.print("* ");
 
-      if (isRepeat) {        
-        Serial.print(F(" (repeated sequence id)"));
+      // ""test" and low battery" aren't real sensors (not attached to a port) so ignore port/sensor number
+      if (sensorType != HHSensorType::LOW_BATT && sensorType != HHSensorType::TEST) {
+        Serial.print(F("port "));
+        Serial.print(data->readings[i].getPort());
+        Serial.print(F(" sensor "));
+        Serial.print(data->readings[i].getSensor());
+        Serial.print(F(": "));
       }
-      Serial.println();
+      Serial.print(HHSensorTypeNames[sensorType]);
+      Serial.print(" ");
+      Serial.print(data->readings[i].getIntPartOfReading());
       
-      for (byte i=0; i<data->numReadings; i++) {
-        uint8_t sensorType = data->readings[i].sensorType;
-
-        Serial.print("* ");
-
-        // ""test" and low battery" aren't real sensors (not attached to a port) so ignore port/sensor number
-        if (sensorType != HHSensorType::LOW_BATT && sensorType != HHSensorType::TEST) {
-          Serial.print(F("port "));
-          Serial.print(data->readings[i].getPort());
-          Serial.print(F(" sensor "));
-          Serial.print(data->readings[i].getSensor());
-          Serial.print(F(": "));
-        }
-        Serial.print(HHSensorTypeNames[sensorType]);
-        Serial.print(" ");
-        Serial.print(data->readings[i].getIntPartOfReading());
-        
-        uint8_t decimal = data->readings[i].getDecPartOfReading();        
-        if (decimal != NO_DECIMAL) {
-          // display as decimal value to 1 decimal place
-          Serial.print(".");
-          Serial.print(decimal);
-        }
-        Serial.println();
+      uint8_t decimal = data->readings[i].getDecPartOfReading();        
+      if (decimal != NO_DECIMAL) {
+        // display as decimal value to 1 decimal place
+        Serial.print(".");
+        Serial.print(decimal);
       }
+      Serial.println();
+    }
+  }
+}
 
-      if (sentAck) {
-        Serial.println(F("Sent ack"));
-        Serial.println();
-      }
+#if SECURE
+/////////////////////////////////////////////////////////////////////
+// check that a node's data is genuine and new, and decrypt it. A secured packet is 8
+// bytes longer than its readings need, so an unsecured one can be told apart. Those
+// are let through for acking if they're test packets, so a node can still find its
+// transmit power, but nothing else about them is trusted.
+byte openSecured(uint16_t node, HeatHackData *data, byte len) {
+  if (len == data->getTransmitSize()) {
+    if (data->numReadings == 1 && data->readings[0].sensorType == HHSensorType::TEST) return OPENED_TEST;
+  }
+  else {
+    uint32_t counter;
+    if (secureOpen(node, (uint8_t *)data, len, counter) == data->getTransmitSize()) {
+      return checkCounter(findNode(node), counter) ? OPENED_DATA : OPENED_DROP;
+    }
+  }
+
+  authFailures++;
+  return OPENED_DROP;
+}
+
+/////////////////////////////////////////////////////////////////////
+// true if a secured packet's counter hasn't been seen from the node before. Copies
+// that came a different way count as duplicates, anything older than the window as
+// replays. A node that loses its slot starts again from its next counter.
+bool checkCounter(byte slot, uint32_t counter) {
+  NodeEntry *entry = &nodeTable[slot];
+
+  if (counter > entry->counter) {
+    uint32_t ahead = counter - entry->counter;
+    entry->window = ahead > SECURE_WINDOW ? 0 : (entry->window << ahead) | (1 << (ahead - 1));
+    entry->counter = counter;
+    return true;
+  }
+
+  uint32_t behind = entry->counter - counter;
+  if (behind > SECURE_WINDOW) {
+    replays++;
+    return false;
+  }
+
+  if (behind == 0 || (entry->window & (1 << (behind - 1)))) {
+    duplicates++;
+    return false;
+  }
+
+  entry->window |= 1 << (behind - 1);
+  return true;
+}
+#endif
+
+#if ADAPTIVE_RATE
+/////////////////////////////////////////////////////////////////////
+// move the node down a step if its packet wasn't clean or came at a slower step than
+// it was given, or up one after a long enough run of clean ones if the signal's
+// strong enough for it (see HeatHackRate.h)
+void adaptRate(byte slot, bool clean) {
+  NodeEntry *entry = &nodeTable[slot];
+
+  if (!clean || packetStep < entry->rateStep) {
+    if (entry->rateStep > 0) {
+      entry->rateStep--;
+      if (entry->rateFails < 3) entry->rateFails++;
+    }
+    entry->rateRun = 0;
+    return;
+  }
+
+  if (entry->rateStep == RATE_STEPS - 1) return;
+
+  // this packet's the last of the run when the count's one short, which keeps the
+  // count within its 6 bits
+  if (entry->rateRun < (RATE_UP_PACKETS << entry->rateFails) - 1) {
+    entry->rateRun++;
+    return;
+  }
+
+  entry->rateRun = 0;
+  if (!packetRssi || packetRssi <= rateMinRssi[entry->rateStep + 1]) entry->rateStep++;
+}
+#endif
+
+/////////////////////////////////////////////////////////////////////
+// the number of the node's packets missed before this new one. The sequence number
+// is 3 bits, so a gap of 8 or more packets is undercounted.
+byte countMissed(byte slot, byte sequence) {
+  NodeEntry *entry = &nodeTable[slot];
+  byte missed = 0;
+
+  if (entry->lastSequence != NODE_NO_SEQUENCE) {
+    missed = (sequence - entry->lastSequence - 1) & 7;
+  }
+
+#if CHANNEL_PLAN
+  channelMissed += missed;
+  channelPackets++;
+#endif
+  return missed;
+}
+
+#if CHANNEL_PLAN
+/////////////////////////////////////////////////////////////////////
+// keep the radio on the group's channel, or the rendezvous channel while it's
+// visiting, survey the channels' noise and decide whether to move
+void updateChannel(void) {
+  static uint32_t lastSurvey = 0;
+  static uint32_t lastCheck = 0;
+  static byte surveyNext = 0;
+
+  channelMoveIfDue();
+
+  // a secondary receiver that's missed a move looks for the group
+  if (!(eepromFlags & FLAG_ACK) && millis() - channelLastHeard > CHANNEL_SCAN_SECS * 1000UL) {
+    channelLastHeard = millis();
+    groupChannel = (groupChannel + 1) % CHANNEL_COUNT;
+  }
+
+  if (millis() - lastCheck >= CHANNEL_CHECK_SECS * 1000UL) {
+    lastCheck = millis();
+    checkChannel();
+  }
+
+  byte listening = channelListening();
+  bool surveyDue = listening == groupChannel && millis() - lastSurvey >= CHANNEL_SURVEY_MS;
+
+  if ((listening == channelTuned && !surveyDue) || !radioCanRetune()) return;
+
+  if (surveyDue) {
+    lastSurvey = millis();
+    tuneChannel(surveyNext);
+    channelNoise[surveyNext] = ((uint16_t) channelNoise[surveyNext] * 7 + channelSampleNoise()) / 8;
+    surveyNext = (surveyNext + 1) % CHANNEL_COUNT;
+    rf12_sleep(RF12_WAKEUP);
+  }
+
+  tuneChannel(listening);
+}
+
+/////////////////////////////////////////////////////////////////////
+// announce a move to the quietest channel if the group's channel is busy or losing
+// packets, and the other's enough quieter that it's worth it
+void checkChannel(void) {
+  uint16_t sent = channelPackets + channelMissed;
+  bool lossy = sent >= CHANNEL_MIN_PACKETS && channelMissed * 100UL >= sent * (uint32_t) CHANNEL_LOSS_PERCENT;
+  channelPackets = 0;
+  channelMissed = 0;
+
+  if (!(eepromFlags & FLAG_ACK) || channelMovePending) return;
+
+  byte quietest = groupChannel;
+  for (byte i=0; i<CHANNEL_COUNT; i++) {
+    if (channelNoise[i] < channelNoise[quietest]) quietest = i;
+  }
+
+  if (channelNoise[quietest] + CHANNEL_NOISE_MARGIN > channelNoise[groupChannel]) return;
+  if (!lossy && channelNoise[groupChannel] < CHANNEL_NOISE_BUSY) return;
+
+  channelNext = quietest;
+  channelMoveAt = millis() + CHANNEL_NOTICE_SECS * 1000UL;
+  channelMovePending = true;
+
+  if (eepromFlags & FLAG_VERBOSE) {
+    Serial.print(F("Moving to channel "));
+    Serial.print(quietest);
+    Serial.print(F(" in "));
+    Serial.print(CHANNEL_NOTICE_SECS);
+    Serial.println(F("s"));
+  }
+}
+#endif
+
+/////////////////////////////////////////////////////////////////////
+// print a line of statistics for the receiver:
+// stats receiver crc <n> duplicates <n> acks <n> stalls <n> evictions <n>
+//   isr <us> auth <n> replays <n> channel <n> noise <%>,<%>,...
+// duplicates counts resent packets from every node, stalls the reports that the
+// receiver had to wait to print as they didn't fit in the serial port's transmit
+// buffer, and evictions nodes that have taken over another's slot in the node
+// table. isr is the longest the RFM12 driver's interrupt took since the last time,
+// if it's built with ISR_PROFILE (see RF12.cpp). It's left out for an RFM69. auth
+// and replays are only there with SECURE, and channel and each channel's noise with
+// CHANNEL_PLAN. Each node's statistics are worked out by the hub from the heathack
+// lines.
+void printStats(void) {
+  Serial.print(F("stats receiver crc "));
+  Serial.print(crcErrors);
+  Serial.print(F(" duplicates "));
+  Serial.print(duplicates);
+  Serial.print(F(" acks "));
+  Serial.print(acksSent);
+  Serial.print(F(" stalls "));
+  Serial.print(serialStalls);
+  Serial.print(F(" evictions "));
+  Serial.print(nodeEvictions);
+#if !RF69_COMPAT
+  Serial.print(F(" isr "));
+  Serial.print(rf12_isrCycles() / clockCyclesPerMicrosecond());
+#endif
+#if SECURE
+  Serial.print(F(" auth "));
+  Serial.print(authFailures);
+  Serial.print(F(" replays "));
+  Serial.print(replays);
+#endif
+#if CHANNEL_PLAN
+  Serial.print(F(" channel "));
+  Serial.print(groupChannel);
+  Serial.print(F(" noise "));
+  for (byte i=0; i<CHANNEL_COUNT; i++) {
+    if (i > 0) Serial.print(',');
+    Serial.print(channelNoise[i] * 100 / 256);
+  }
+#endif
+  Serial.println();
+  serialFlush();
+}
+
+/////////////////////////////////////////////////////////////////////
+// take the SAMPLE_TIME reading out of the data and return how many seconds ago the
+// readings were taken, or -1 if the node didn't send it or it's out of range.
+// Nodes keep to the main receiver's clock, which a secondary receiver follows from
+// the acks it hears.
+int16_t takeSampleAge(HeatHackData *data) {
+  for (byte i=0; i<data->numReadings; i++) {
+    if (data->readings[i].sensorType != HHSensorType::SAMPLE_TIME) continue;
+
+    uint16_t sampleTime = data->readings[i].encodedReading;
+
+    memmove(&data->readings[i], &data->readings[i+1], (data->numReadings - i - 1) * sizeof(HHReading));
+    data->numReadings--;
+
+    uint32_t now = millis();
+#if TIME_SYNC
+    if (!(eepromFlags & FLAG_ACK)) {
+      if (!haveReceiverTime()) return -1;
+      now = receiverTime();
     }
+#endif
+    uint16_t age = (uint16_t) (now / 1000) - sampleTime;
+
+    // the node's estimate of the receiver's clock can be a little ahead
+    if (age > 0xFFFF - 60) return 0;
+    return age <= MAX_SAMPLE_AGE_SECS ? age : -1;
   }
+
+  return -1;
 }
 
-void reportReadings(byte node, HeatHackData *data) {
+/////////////////////////////////////////////////////////////////////
+void reportReadings(uint16_t node, HeatHackData *data, int16_t age, byte lost) {
+  // the serial port only blocks once its transmit buffer's full, so a report that
+  // doesn't fit in the room left is one the receiver waits for
+  int room = Serial.availableForWrite();
+  int printed = 0;
+
   // print out sensor readings on the serial port
-  // format is: heathack <node id> <port num><sensor num> <sensor type> <reading> <port num><sensor num> <sensor type> <reading> ...(repeated for each reading)
+  // format is: heathack <node id> #<sequence> [~<rssi>] [!<lost>] [@<age>] <port num><sensor num> <sensor type> <reading> <port num><sensor num> <sensor type> <reading> ...(repeated for each reading)
   // Note port and sensor numbers are combined to report a single two-digit sensor number
+  // The sequence number lets the hub match up the same packet from several receivers.
+  // rssi is the signal strength in dBm, if the radio measures it.
+  // lost is how many of the node's packets were missed before this one, if any
+  // age is how many seconds ago the readings were taken, if the node knows
   
   // start each line with a known string so that the code reading from the serial port can ignore spurious data
-  Serial.print("heathack ");
-  Serial.print(node);
-  Serial.print(" ");
+  printed += Serial.print("heathack ");
+  printed += Serial.print(node);
+  printed += Serial.print(" #");
+  printed += Serial.print(data->sequence);
+  printed += Serial.print(" ");
+
+  if (packetRssi) {
+    printed += Serial.print("~-");
+    printed += Serial.print(packetRssi / 2);
+    printed += Serial.print(" ");
+  }
+
+  if (lost) {
+    printed += Serial.print("!");
+    printed += Serial.print(lost);
+    printed += Serial.print(" ");
+  }
+
+  if (age >= 0) {
+    printed += Serial.print("@");
+    printed += Serial.print(age);
+    printed += Serial.print(" ");
+  }
     
   for (byte i=0; i<data->numReadings; i++) {
     uint8_t sensorType = data->readings[i].sensorType;
 
     if (sensorType == HHSensorType::LOW_BATT) {
       // "low battery" isn't a real sensor (not attached to a port) so ignore port/sensor number and always use 1
-      Serial.print("1");
+      printed += Serial.print("1");
     }
     else {
-      Serial.print(data->readings[i].getPort());
-      Serial.print(data->readings[i].getSensor());
+      printed += Serial.print(data->readings[i].getPort());
+      printed += Serial.print(data->readings[i].getSensor());
     }
-    Serial.print(" ");
-    Serial.print(sensorType);
-    Serial.print(" ");
-    Serial.print(data->readings[i].getIntPartOfReading());
+    printed += Serial.print(" ");
+    printed += Serial.print(sensorType);
+    printed += Serial.print(" ");
+    printed += Serial.print(data->readings[i].getIntPartOfReading());
     
     uint8_t decimal = data->readings[i].getDecPartOfReading();        
     if (decimal != NO_DECIMAL) {
       // display as decimal value to 1 decimal place
-      Serial.print(".");
-      Serial.print(decimal);
+      printed += Serial.print(".");
+      printed += Serial.print(decimal);
     }        
-    Serial.print(" ");
+    printed += Serial.print(" ");
   }
 
-  Serial.println();
+  printed += Serial.println();
+
+  if (printed > room) serialStalls++;
+
   serialFlush();
-}
+}
@@ -0,0 +1,425 @@
+/**
+ * Passes on packets from nodes that the receiver can't hear. The repeater is mains
+ * powered and listens all the time, so put it where both the receiver and the
+ * out-of-range nodes can hear it. Give it its own node id with the config console.
+ *
+ * When a node's data packet arrives the repeater listens briefly for the receiver's
+ * ack to it. If the receiver got the packet that's all. Otherwise the repeater acks
+ * the node itself, so the node doesn't keep retrying at full power or go into
+ * hibernation, and forwards the data to the receiver with the node's id and a hop
+ * count. Packets that arrive close together are sent on in one packet. Its acks
+ * carry the receiver's clock, as it last heard it, for the node's sample times.
+ *
+ * A node resends a packet if it misses the ack, so recent (node, sequence) pairs are
+ * remembered and a repeat is acked again but not forwarded again.
+ *
+ * If it hasn't heard the receiver ack anything for MAX_SECS_WITHOUT_ACK it stops
+ * acking nodes, but still forwards their data until the receiver acks that.
+ *
+ * With CHANNEL_PLAN the repeater follows the receiver's channel moves, passes them
+ * on in its acks, and visits the rendezvous channel with the receiver.
+ *
+ * Packets from other repeaters aren't passed on. A repeater can't tell whether the
+ * receiver heard another repeater, and acking on the receiver's behalf would stop the
+ * other repeater retrying a packet that never arrived.
+ */
+
+// enable the repeater's config console commands
+#define REPEATER_NODE true
+
+// make rfm69 radio operate in rf12 mode
+#define RF69_COMPAT 1
+
+// or use the rfm69's own packet format, which keeps the radio and processor busy
+// for much less time per packet. Every radio in the group has to use the same.
+//#define RF69_NATIVE 1
+
+// move the group to another channel when something else is using this one. Every
+// radio in the group has to use it. See HeatHackChannel.h.
+//#define CHANNEL_PLAN true
+
+#include <JeeLib.h>
+#include <OneWire.h>
+#include <PinChange.h>
+#include <HeatHack.h>
+#include <HeatHackShared.h>
+
+// time on air for n bytes of packet data at the default 49.2 kbps, 162.4us a byte,
+// with the preamble, sync word, header, length, CRC and the byte after it
+#define AIRTIME_US(n) (((n) + 10) * 1624L / 10)
+
+// the longest ack from the receiver: an extended node's id, its clock, a channel
+// move, a rate step and a trace request. And how long the receiver may take to
+// check the packet (see HeatHackSecure.h) and turn its radio round.
+#define RECEIVER_ACK_MAX (2 + 5 + 6 + 2 + 1)
+#define RECEIVER_TURNAROUND_US 2000
+
+// the longest ack from the repeater: the id, clock and channel move, and how long
+// its radio takes to start sending
+#define REPEATER_ACK_MAX (2 + 5 + 6)
+#define REPEATER_TURNAROUND_US 250
+
+// time to listen for the receiver's ack to a node before acking it, plus up to
+// REPEATER_ACK_JITTER_US so that two repeaters that heard the same packet don't ack
+// at the same time. It keeps listening while a packet's coming in, as that may be
+// the ack.
+#define REPEATER_ACK_LISTEN_US (RECEIVER_TURNAROUND_US + AIRTIME_US(RECEIVER_ACK_MAX))
+#define REPEATER_ACK_JITTER_US 3000
+
+// the node waits ACK_TIME for its ack, which it times to the ms
+#if REPEATER_ACK_LISTEN_US + REPEATER_ACK_JITTER_US + REPEATER_TURNAROUND_US + AIRTIME_US(REPEATER_ACK_MAX) + 1000 > ACK_TIME * 1000L
+  #error The repeater may ack after the node has stopped waiting, so ACK_TIME needs to be longer
+#endif
+
+// how long forwarded data is held for more to be sent with it
+#define REPEATER_HOLD_MS 500
+
+// time to wait for the receiver's ack to forwarded data before resending it, and how
+// many times it's sent before it's dropped
+#define REPEATER_RETRY_MS 250
+#define REPEATER_RETRY_LIMIT 5
+
+// number of recent (node, sequence) pairs remembered, and for how long. The sequence
+// number is only 3 bits so it comes round again after 8 packets. A node's resends are
+// over within RETRY_LIMIT * RETRY_PERIOD, which is less than the shortest interval.
+#define REPEATER_RECENT_SIZE 16
+#define REPEATER_RECENT_MS 8000
+
+struct RecentPacket {
+  uint16_t node;
+  byte sequence;
+  uint32_t heardAt;
+};
+
+RecentPacket recent[REPEATER_RECENT_SIZE];
+byte recentNext = 0;
+
+// data waiting to be forwarded, a HHRepeatedHeader and HeatHackData for each node
+struct {
+  HHExtHeader header;
+  byte entries[HH_MAX_PACKET - sizeof(HHExtHeader)];
+} forward;
+
+byte forwardLen = 0;        // bytes used in forward.entries
+byte forwardSentLen = 0;    // bytes of forward.entries in the packet waiting for an ack
+byte forwardTries = 0;      // number of times that packet's been sent
+uint32_t forwardStart;      // when the first entry was added
+uint32_t forwardSentAt;     // when the packet was last sent
+
+// counts for the verbose output
+uint16_t forwardedCount = 0;
+uint16_t droppedCount = 0;
+
+/////////////////////////////////////////////////////////////////////
+void setup() {
+
+  readEeprom();
+
+  Serial.begin(BAUD_RATE);
+
+  Serial.print("JeeNode HeatHack Repeater v");
+  Serial.println(VERSION);
+
+  configConsole();
+
+  Serial.println();
+  Serial.print(F("Using group id "));
+  Serial.print(myGroupID);
+  Serial.print(F(" and node id "));
+  Serial.println(nodeID());
+  Serial.println();
+  Serial.flush();
+
+  for (byte i=0; i<REPEATER_RECENT_SIZE; i++) {
+    recent[i].node = 0;
+  }
+
+  forward.header.kind = HH_PACKET_REPEATED;
+  forward.header.nodeId = nodeID();
+
+  // initialise transceiver. The extended node RF12 id hears packets sent to any node,
+  // which includes the receiver's acks.
+  rf12_initialize(EXT_RF12_NODE_ID, RF12_868MHZ, myGroupID);
+  setMaxTransmitPower();
+}
+
+
+/////////////////////////////////////////////////////////////////////
+void loop() {
+  if (rf12_recvDone() && rf12_crc == 0) {
+    if (forwardSentLen > 0 && isBroadcastAckTo(nodeID())) {
+      receiverAcked();
+    }
+    else if (RF12_WANTS_ACK) {
+      repeatPacket();
+    }
+    else if (isAck()) {
+      // the receiver's answering someone, so it's still there to speak for
+      lastAckTime = millis();
+    }
+  }
+
+  sendForward();
+
+#if CHANNEL_PLAN
+  // follow the group's moves, and visit the rendezvous channel with the receiver
+  // for nodes that have lost the group
+  channelMoveIfDue();
+  byte listening = channelListening();
+  if (listening != channelTuned && radioCanRetune()) tuneChannel(listening);
+#endif
+}
+
+
+/////////////////////////////////////////////////////////////////////
+// true if the node's packet with this sequence number has been seen recently.
+// Remembers it if not.
+bool isRecent(uint16_t node, byte sequence) {
+  uint32_t now = millis();
+
+  for (byte i=0; i<REPEATER_RECENT_SIZE; i++) {
+    if (recent[i].node == node && recent[i].sequence == sequence && now - recent[i].heardAt < REPEATER_RECENT_MS) {
+      return true;
+    }
+  }
+
+  recent[recentNext].node = node;
+  recent[recentNext].sequence = sequence;
+  recent[recentNext].heardAt = now;
+  recentNext = (recentNext + 1) % REPEATER_RECENT_SIZE;
+  return false;
+}
+
+
+/////////////////////////////////////////////////////////////////////
+// true if the packet just received is an ack, to any node
+bool isAck(void) {
+  return (rf12_hdr & (RF12_HDR_CTL | RF12_HDR_ACK)) == RF12_HDR_CTL;
+}
+
+
+/////////////////////////////////////////////////////////////////////
+// listen for an ack to the node from the receiver, or from another repeater acking
+// on its behalf. Returns true if one's heard.
+bool listenForAck(uint16_t node, bool broadcastAck) {
+  uint32_t start = micros();
+  uint32_t wait = REPEATER_ACK_LISTEN_US + random(REPEATER_ACK_JITTER_US + 1);
+
+  // a packet that's still coming in when the time's up may be the ack, until the
+  // node stops waiting for it
+  while (micros() - start < wait || (rf12_receiving() && micros() - start < ACK_TIME * 1000UL)) {
+    if (rf12_recvDone() && rf12_crc == 0 && isAck()) {
+      lastAckTime = millis();
+      if (broadcastAck ? isBroadcastAckTo(node) : rf12_hdr == (RF12_HDR_DST | RF12_HDR_CTL | node)) {
+        return true;
+      }
+    }
+  }
+
+  return false;
+}
+
+
+/////////////////////////////////////////////////////////////////////
+// handle a packet that wants an ack. Data from a node is acked and forwarded if the
+// receiver doesn't ack it.
+void repeatPacket(void) {
+  // take a copy as listening for the receiver's ack overwrites the receive buffer
+  byte packet[RF12_MAXDATA];
+  byte hdr = rf12_hdr;
+  byte len = rf12_len;
+  memcpy(packet, (const void*) rf12_data, len);
+
+  uint16_t node;
+  HeatHackData *data;
+
+  if (hdr & RF12_HDR_DST) {
+    // only an extended node's data, not other repeaters' packets
+    HHExtHeader *header = (HHExtHeader *)packet;
+    if ((hdr & RF12_HDR_MASK) != RECEIVER_NODE_ID || len < sizeof(HHExtHeader) + 1 || header->kind != HH_PACKET_DATA) return;
+
+    node = header->nodeId;
+    data = (HeatHackData *)&packet[sizeof(HHExtHeader)];
+    len -= sizeof(HHExtHeader);
+  }
+  else {
+    if (len < 1) return;
+
+    node = hdr & RF12_HDR_MASK;
+    data = (HeatHackData *)packet;
+  }
+
+  bool isRepeat = isRecent(node, data->sequence);
+
+  if (listenForAck(node, hdr & RF12_HDR_DST)) return;
+
+  // don't speak for the receiver if it's stopped answering. The data's still
+  // forwarded, so the receiver's ack to that shows when it's back.
+  bool receiverAnswering = millis() - lastAckTime <= ((uint32_t)MAX_SECS_WITHOUT_ACK) * 1000;
+  if (receiverAnswering) sendAck(hdr, node);
+
+  // test packets are only for finding the transmit power, which the ack has done.
+  // They're never secured, and a secured packet's readings can't be read here.
+  bool isTest = len == data->getTransmitSize() && data->numReadings == 1 && data->readings[0].sensorType == HHSensorType::TEST;
+
+  if (!isRepeat && !isTest) {
+    addForward(node, data, len);
+    flashLED();
+  }
+
+  if (eepromFlags & FLAG_VERBOSE) {
+    Serial.print(receiverAnswering ? F("Acked node ") : F("Not acking node "));
+    Serial.print(node);
+    Serial.print(F(" seq "));
+    Serial.print(data->sequence);
+    if (isRepeat) Serial.print(F(" (repeated sequence id)"));
+    Serial.println();
+  }
+}
+
+
+/////////////////////////////////////////////////////////////////////
+// ack a node's data on the receiver's behalf. hdr is the header of the node's packet.
+void sendAck(byte hdr, uint16_t node) {
+  byte ack[REPEATER_ACK_MAX];
+  byte ackLen = 0;
+
+  if (hdr & RF12_HDR_DST) {
+    ack[ackLen++] = node & 0xFF;
+    ack[ackLen++] = node >> 8;
+  }
+
+#if TIME_SYNC
+  // pass on the receiver's clock as the receiver would
+  if (haveReceiverTime()) {
+    uint32_t now = receiverTime();
+    ack[ackLen++] = ACK_TIME_SYNC;
+    memcpy(&ack[ackLen], &now, sizeof(now));
+    ackLen += sizeof(now);
+  }
+#endif
+
+#if CHANNEL_PLAN
+  // and the receiver's channel moves
+  ackLen += addChannelAck(&ack[ackLen]);
+#endif
+
+  if (hdr & RF12_HDR_DST) {
+    rf12_sendStart(RF12_HDR_CTL, ack, ackLen);
+  }
+  else {
+    rf12_sendStart(RF12_HDR_DST | RF12_HDR_CTL | node, ack, ackLen);
+  }
+  rf12_sendWait(1);
+}
+
+
+/////////////////////////////////////////////////////////////////////
+// add a node's data to the packet waiting to be forwarded. If there isn't room the
+// oldest data is dropped.
+void addForward(uint16_t node, HeatHackData *data, byte size) {
+  byte entrySize = sizeof(HHRepeatedHeader) + size;
+  if (entrySize > sizeof(forward.entries)) return;
+
+  while (forwardLen + entrySize > sizeof(forward.entries)) {
+    droppedCount += dropForward(1);
+  }
+
+  if (forwardLen == 0) forwardStart = millis();
+
+  HHRepeatedHeader *entry = (HHRepeatedHeader *)&forward.entries[forwardLen];
+  entry->nodeId = node;
+  entry->hops = 1;
+  entry->size = size;
+  memcpy(&forward.entries[forwardLen + sizeof(HHRepeatedHeader)], data, size);
+
+  forwardLen += entrySize;
+}
+
+
+/////////////////////////////////////////////////////////////////////
+// remove at least this many bytes of entries from the start of forward.entries.
+// Returns the number of entries removed.
+byte dropForward(byte bytes) {
+  byte removed = 0;
+  byte count = 0;
+
+  while (removed < bytes && removed < forwardLen) {
+    removed += sizeof(HHRepeatedHeader) + ((HHRepeatedHeader *)&forward.entries[removed])->size;
+    count++;
+  }
+
+  memmove(forward.entries, &forward.entries[removed], forwardLen - removed);
+  forwardLen -= removed;
+  forwardSentLen = forwardSentLen > removed ? forwardSentLen - removed : 0;
+
+  if (forwardSentLen == 0) forwardTries = 0;
+  if (forwardLen > 0) forwardStart = millis();
+
+  return count;
+}
+
+
+/////////////////////////////////////////////////////////////////////
+// the receiver has the data that was last sent
+void receiverAcked(void) {
+  lastAckTime = millis();
+  readAckData(2);
+  byte tries = forwardTries;
+
+#if CHANNEL_PLAN
+  if (!channelMovePending) channelLost = false;
+#endif
+
+  forwardedCount += dropForward(forwardSentLen);
+
+  if (eepromFlags & FLAG_VERBOSE) {
+    Serial.print(F("Receiver acked after "));
+    Serial.print(tries);
+    Serial.print(F(" tries. Forwarded "));
+    Serial.print(forwardedCount);
+    Serial.print(F(" packets, dropped "));
+    Serial.println(droppedCount);
+  }
+}
+
+
+/////////////////////////////////////////////////////////////////////
+// send the data waiting to be forwarded once it's been held long enough or there's
+// no room for more, and resend it until the receiver acks it
+void sendForward(void) {
+  if (forwardLen == 0) return;
+
+  uint32_t now = millis();
+
+  if (forwardSentLen > 0) {
+    if (now - forwardSentAt < REPEATER_RETRY_MS) return;
+
+    if (forwardTries >= REPEATER_RETRY_LIMIT) {
+      // give up on what was sent, anything added since gets its own tries
+      droppedCount += dropForward(forwardSentLen);
+#if CHANNEL_PLAN
+      channelFallBack();
+#endif
+      return;
+    }
+  }
+  else {
+    // a reading's the smallest data that can be added
+    bool hasRoom = forwardLen + sizeof(HHRepeatedHeader) + 1 + sizeof(HHReading) <= sizeof(forward.entries);
+    if (hasRoom && now - forwardStart < REPEATER_HOLD_MS) return;
+  }
+
+#if CHANNEL_PLAN
+  // the receiver's only on the rendezvous channel now and then
+  if (channelLost && !inRendezvous()) return;
+#endif
+
+  // anything added since the last try goes with this one
+  forwardSentLen = forwardLen;
+  forwardTries++;
+  forwardSentAt = now;
+
+  rf12_sendNow(RF12_HDR_DST | RF12_HDR_ACK | RECEIVER_NODE_ID, &forward, sizeof(HHExtHeader) + forwardLen);
+  rf12_sendWait(1);
+}
@@ -0,0 +1,97 @@
+/**
+ * Times securing and checking HeatHack packets (see HeatHackSecure.h) for each
+ * number of readings, and prints what it adds to a packet. Run it on a JeeNode with
+ * the serial monitor open; it doesn't use the radio or the key in EEPROM.
+ *
+ * Each line is: <readings> <bytes sent> +<bytes added> seal <cycles> open <cycles>
+ */
+
+#define SECURE true
+
+#include <JeeLib.h>
+#include <HeatHack.h>
+#include <HeatHackSecure.h>
+
+#define BENCH_RUNS 100
+
+// the Speck64/128 test vector's key, plain text and cipher text
+const uint8_t testKey[16] = { 0x00, 0x01, 0x02, 0x03, 0x08, 0x09, 0x0a, 0x0b, 0x10, 0x11, 0x12, 0x13, 0x18, 0x19, 0x1a, 0x1b };
+const uint32_t testPlain[2] = { 0x7475432d, 0x3b726574 };
+const uint32_t testCipher[2] = { 0x454e028b, 0x8c6fa548 };
+
+/////////////////////////////////////////////////////////////////////
+void setup() {
+  Serial.begin(BAUD_RATE);
+  Serial.println(F("HeatHack security benchmark"));
+
+  secureSetKey(testKey);
+  secureKeySet = true;
+
+  uint32_t block[2] = { testPlain[0], testPlain[1] };
+  secureEncrypt(block);
+  Serial.print(F("Speck test vector "));
+  Serial.println(block[0] == testCipher[0] && block[1] == testCipher[1] ? F("ok") : F("FAILED"));
+  Serial.println();
+
+  for (byte n = 1; n <= HH_MAX_READINGS; n++) {
+    benchReadings(n);
+  }
+}
+
+/////////////////////////////////////////////////////////////////////
+void loop() {
+}
+
+/////////////////////////////////////////////////////////////////////
+// time sealing and opening a packet with n readings, less the time to copy it
+void benchReadings(byte n) {
+  HeatHackData data;
+  data.clear();
+  for (byte i = 0; i < n; i++) {
+    HHReading reading;
+    reading.setPort(1);
+    reading.setSensor(1);
+    reading.sensorType = HHSensorType::TEMPERATURE;
+    reading.encodedReading = 200 + i;
+    data.addReading(reading);
+  }
+
+  byte len = data.getTransmitSize();
+  byte packet[sizeof(HeatHackData) + SECURE_TRAILER];
+  byte sealedLen = 0;
+  byte openedLen = 0;
+  uint32_t counter;
+
+  uint32_t start = micros();
+  for (byte i = 0; i < BENCH_RUNS; i++) {
+    memcpy(packet, &data, len);
+  }
+  uint32_t copyTime = micros() - start;
+
+  start = micros();
+  for (byte i = 0; i < BENCH_RUNS; i++) {
+    memcpy(packet, &data, len);
+    sealedLen = secureSeal(1, i + 1, packet, len);
+  }
+  uint32_t sealTime = micros() - start - copyTime;
+
+  start = micros();
+  for (byte i = 0; i < BENCH_RUNS; i++) {
+    // opening decrypts in place, so it's sealed again each time
+    secureSeal(1, i + 1, packet, len);
+    openedLen = secureOpen(1, packet, sealedLen, counter);
+  }
+  uint32_t openTime = micros() - start - sealTime;
+
+  Serial.print(n);
+  Serial.print(' ');
+  Serial.print(sealedLen);
+  Serial.print(F(" +"));
+  Serial.print(sealedLen - len);
+  Serial.print(F(" seal "));
+  Serial.print(sealTime * clockCyclesPerMicrosecond() / BENCH_RUNS);
+  Serial.print(F(" open "));
+  Serial.print(openTime * clockCyclesPerMicrosecond() / BENCH_RUNS);
+  if (openedLen != len || memcmp(packet, &data, len) != 0) Serial.print(F(" FAILED"));
+  Serial.println();
+}
@@ -48,6 +48,9 @@
 // to free up some memory.
 //#define DEBUG true
 
+// record events in a ring buffer that can be sent to the receiver. See HeatHackTrace.h.
+//#define TRACE true
+
 #define ENABLE_DHT true
 #define ENABLE_DS18B true
 
@@ -257,6 +260,8 @@ void configConsole(void) {
 /////////////////////////////////////////////////////////////////////
 void setup() {
 
+  traceInit();
+
   // wait for things to stablise
 //  Sleepy::loseSomeTime(1000);
 
@@ -1,24 +1,38 @@
 /**
- * Default setup is:
+ * The sensors are found when the node starts up, so the same sketch works whatever is
+ * attached to the ports. By default every port is auto-detected, which finds:
  *
- * - A OneWire bus on port 3 data pin supporting multiple DS18B temp sensors.
+ * - A OneWire bus on the data pin supporting multiple DS18B temp sensors.
  * If power is drawn from the A pin instead of +, then the sensors will only be powered
  * when needed to avoid wasting power.
  * Parasitic power mode is supported transparently, though may need a slightly lower value pull-up
  * resistor e.g. 3600 instead of 4700 ohms.
  *
- * - DHT11/22 temp/humidty sensor on port 1 with its data line connected to the D pin. Again, A
+ * - DHT11/22 temp/humidty sensor with its data line connected to the D pin. Again, A
  * can be used instead of + to power it only when taking readings.
  *
- * - LCD display on port 2. If connected it will be used to display readings.
+ * - LCD display. If connected it will be used to display readings.
  *
- * To enable/disable the various sensors depending on your setup, comment/uncomment the lines
- * defining the port for the relevant sensor.
+ * - The room board's HYT131 temp/humidity sensor.
+ *
+ * - BMP085 pressure sensor (JeeLabs pressure plug).
+ *
+ * What's found is remembered in EEPROM so that next time the node only needs to check
+ * each sensor is still there. Sensors that can't be detected are set for their port in
+ * the config console with the p command.
  *
  * Room board should be connected to ports 2 and 3 with the PIR sensor pointing away from the other ports.
  * With the writing on the room board the right way up, port 2 is on the left and port 3 on the right.
  * This means the HYT131 temp/humidity sensor is on port 2, LDR light sensor on port 3 A pin and
- * PIR motion sensor on port 3 D pin.
+ * PIR motion sensor on port 3 D pin. Port 3 needs setting to "room board" (p3 8).
+ *
+ * After a power cut the node does a warm boot. It skips the config console and uses the
+ * sensors and transmit power it found last time, checking just the I2C devices, so the
+ * first reading goes out straight away. Press reset (twice if the first doesn't give the
+ * console) for a full start up.
+ *
+ * The config console is only offered if a serial adapter is connected. Once the node's
+ * running, pressing a key wakes it up and offers the console again.
  */
 
 #define DEBUG false
@@ -29,138 +43,69 @@
   #define DEBUG_INDICATOR ""
 #endif
 
-// dht11/22 temp/humidity
-#define DHT_PORT 1
-// can't have DHT and PIR both using interrupts
-#define DHT_USE_INTERRUPTS false
+// record events in a ring buffer that can be printed from the config console or
+// sent to the receiver. See HeatHackTrace.h.
+//#define TRACE true
+
+// secure the readings so they can't be forged or replayed, which the receiver has
+// to be built for too. Set the key with the config console. See HeatHackSecure.h.
+//#define SECURE true
+
+// only read and report DS18B sensors whose temperature has changed
+//#define DS18B_ALARM_MODE true
 
-// Dallas DS18B switchable parasitic power board
-#define DS18B_PORT 3
+// To build a smaller image for a node whose sensors are always the same, list them
+// here instead of detecting them at start up. See HeatHackNode.h.
+//#define NODE_SENSORS DS18BOn<3>, DHTOn<1>, LCDOn<2>
 
-// room node module
-//#define HYT131_PORT 2   // the temp/humidity sensor
-//#define LDR_PORT    3   // light sensor
-//#define PIR_PORT    3   // motion detector
+// for a node with an rfm69 radio in a group whose receiver uses its native packet
+// format (see RF69_compat.h)
+//#define RF69_NATIVE 1
 
-// LCD display
-#define LCD_PORT 2
+// move the group to another channel when something else is using this one. Every
+// radio in the group has to use it. See HeatHackChannel.h.
+//#define CHANNEL_PLAN true
+
+// let the receiver give the node a faster data rate if its signal's strong enough.
+// The receiver has to use it too. See HeatHackRate.h.
+//#define ADAPTIVE_RATE true
 
 #include <Arduino.h>
 #include "JeeLib.h"
 #include "PortsLCD.h"
+#include "PortsBMP085.h"
 #include "OneWire.h"
+#include "PinChange.h"
 
 #include "HeatHack.h"
+#include "HeatHackClock.h"
+#include "HeatHackTrace.h"
 #include "HeatHackSensors.h"
+#include "HeatHackRoomBoard.h"
+#include "HeatHackBMP085.h"
+#include "HeatHackRegistry.h"
+#include "HeatHackNode.h"
+#include "HeatHackFilter.h"
 #include "HeatHackShared.h"
 
 
-#if DHT_PORT
-  DHT dht(DHT_PORT);
-#endif
-
-#if DS18B_PORT
-  DS18B ds18b(DS18B_PORT);
-  uint8_t ds18bNumDevices;
-#endif
-
-#if HYT131_PORT
-    PortI2C hytI2C(HYT131_PORT);
-    HYT131 hyt131(hytI2C);
-#endif
-
-#if LDR_PORT
-    Port ldr(LDR_PORT);
+#ifdef NODE_SENSORS
+  static Node<NODE_SENSORS> sensors;
+#else
+  static SensorRegistry sensors;
 #endif
 
-#if LCD_PORT
-  PortI2C lcdI2C(LCD_PORT);
-  LiquidCrystalI2C lcd(lcdI2C);
-  bool isLCDEnabled = false;
-#endif
+// removes spikes and noise from the readings
+static ReadingFilter readingFilter;
 
-#if PIR_PORT
-    #include <util/atomic.h>
-
-    #define PIR_HOLD_TIME    1  // hold PIR value this many seconds after change
-    #define PIR_PULLUP       1   // set to one to pull-up the PIR input pin
-    #define PIR_INVERTED     1   // 0 or 1, to match PIR reporting high or low
-    #define PIR_STARTUP_SECS 120 // wait this many secs before enabling interrupt to
-                                 // avoid spurious triggers while device is stabilising
-    
-    /// Interface to a Passive Infrared motion sensor.
-    class PIR : public Port {
-        volatile byte value;
-        volatile uint16_t count;
-        volatile uint32_t lastOn;
-    public:
-        PIR (byte portnum)
-            : Port (portnum), value (0), count (0), lastOn (0) {}
-
-        // this code is called from the pin-change interrupt handler
-        void poll(void) {
-            // see http://talk.jeelabs.net/topic/811#post-4734 for PIR_INVERTED
-            byte pin = digiRead() ^ PIR_INVERTED;
-            // if the pin just went on, then set the changed flag to report it
-            if (pin) {
-                if (!state()) count++;
-                lastOn = millis();
-            }
-            value = pin;
-        }
-
-        // state is true if curr value is still on or if it was on recently
-        byte state(void) const {
-            byte f = value;
-            if (lastOn > 0) {
-                ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
-                    if (millis() - lastOn < PIR_HOLD_TIME * 1000) {
-                        f = 1;
-                    }
-                }
-            }
-            
-            return f;
-        }
-
-        // return number of motion triggers since last time the method was called
-        uint16_t triggerCount(void) {
-            uint16_t result = count;
-            count = 0;
-            return result;
-        }
-        
-        void enableInterrupt(void) {
-          #if DEBUG
-            Serial.println(F("enabling PIR interrupts"));
-            serialFlush();
-          #endif
-
-          bitSet(PCMSK2, PIR_PORT + 3);
-          bitSet(PCICR, PCIE2);
-        }
-        
-        void disableInterrupt(void) {
-          #if DEBUG
-            Serial.println(F("disabling PIR interrupts"));
-            serialFlush();
-          #endif
-
-          bitClear(PCICR, PCIE2);
-        }
-    };
-
-    PIR pir (PIR_PORT);
-
-    // the PIR signal comes in via a pin-change interrupt
-    ISR(PCINT2_vect) { pir.poll(); }
-#endif
+// LCD display, if there is one
+static LCDDisplay* display = 0;
+static LiquidCrystalI2C* lcd = 0;
 
 
 /////////////////////////////////////////////////////////////////////
 void doMeasure() {
   static bool firstMeasure = true;
-  int humi, temp;
   
   // format data packet
   dataPacket.clear();
@@ -173,126 +118,119 @@ void doMeasure() {
     dataPacket.addReading(reading);
   }
 
-#if DHT_PORT
-  dht.reading(dataPacket);
-#endif
-
-#if DS18B_PORT
-  ds18b.reading(dataPacket);
-#endif
-
-#if HYT131_PORT
-    hyt131.reading(temp, humi);
-    dataPacket.addReading(SENSOR_TEMP, HHSensorType::TEMPERATURE, temp);
-    dataPacket.addReading(SENSOR_HUMIDITY, HHSensorType::HUMIDITY, humi);
-#endif
-
-#if LDR_PORT
-    ldr.digiWrite2(1);  // enable AIO pull-up
-    byte light = ~ ldr.anaRead() >> 2;
-    ldr.digiWrite2(0);  // disable pull-up to reduce current draw
-    
-    dataPacket.addReading(SENSOR_LIGHT, HHSensorType::LIGHT, light);
-#endif
-
-#if PIR_PORT
-    dataPacket.addReading(SENSOR_MOTION, HHSensorType::MOTION, pir.triggerCount());
-#endif
+  // sensors that need the full clock switch back to it themselves
+  {
+    SlowClock slowClock;
+    sensors.measure(dataPacket);
+    readingFilter.apply(dataPacket);
+  }
 
   firstMeasure = false;
 }
 
 
 /////////////////////////////////////////////////////////////////////
-#if LCD_PORT
-
-bool isLCDConnected(void) {
-
-  // need to pass address as top 7 bits with lsb indicating read/write
-  bool result = lcdI2C.start(I2C_LCD << 1);
-  delayMicroseconds(150);
-  lcdI2C.stop();
-
-  return result;
-}
-
 void displayReadingsOnLCD(void) {
 
-  if (!isLCDEnabled) return;
+  if (!lcd) return;
+
+  SlowClock slowClock;
 
-  lcd.clear();
+  lcd->clear();
 
   // display 1st 4 readings
   for (byte i=0; i<4 && i<dataPacket.numReadings; i++) {
     switch (i) {
       case 0:
-        lcd.setCursor(0,0);
+        lcd->setCursor(0,0);
         break;
       case 1:
-        lcd.setCursor(8,0);
+        lcd->setCursor(8,0);
         break;
       case 2:
-        lcd.setCursor(0,1);
+        lcd->setCursor(0,1);
         break;
       case 3:
-        lcd.setCursor(8,1);
+        lcd->setCursor(8,1);
         break;
     }
 
-    lcd.print(dataPacket.readings[i].getPort());
-    lcd.print(dataPacket.readings[i].getSensor());
-    lcd.print(F(":"));
-    lcd.print(dataPacket.readings[i].getIntPartOfReading());
+    lcd->print(dataPacket.readings[i].getPort());
+    lcd->print(dataPacket.readings[i].getSensor());
+    lcd->print(F(":"));
+    lcd->print(dataPacket.readings[i].getIntPartOfReading());
 
     uint8_t decimal = dataPacket.readings[i].getDecPartOfReading();        
     if (decimal != NO_DECIMAL) {
       // display as decimal value to 1 decimal place
-      lcd.print(F("."));
-      lcd.print(decimal);
+      lcd->print(F("."));
+      lcd->print(decimal);
     }
-    lcd.print(HHSensorUnitNames[dataPacket.readings[i].sensorType]);
+    lcd->print(HHSensorUnitNames[dataPacket.readings[i].sensorType]);
   }  
 }
-#endif
 
 /////////////////////////////////////////////////////////////////////
 void setup() {
 
-  // wait for things to stabilise
-  delay(1000);
+  traceInit();
+
+  uint8_t resetFlags = MCUSR;
+  MCUSR = 0;
 
   readEeprom();
+  bool warmBoot = startBoot(resetFlags);
+
+  // wait for things to stabilise
+  if (!warmBoot) delay(1000);
 
   uint8_t mins, secs;
 
-  #if LCD_PORT
-
-    isLCDEnabled = isLCDConnected();
-
-    if (isLCDEnabled) {
-      lcd.begin(LCD_WIDTH, LCD_HEIGHT);
-      lcd.noBacklight();
-
-      mins = myInterval / 6;
-      secs = (myInterval % 6) * 10;
-
-      lcd.print(F("HeatHack v" VERSION DEBUG_INDICATOR));
-      lcd.setCursor(0,1);
-      lcd.print(F("G:"));
-      lcd.print(myGroupID);
-      lcd.print(F(" N:"));
-      lcd.print(myNodeID);
-      lcd.print(F(" I:"));
-      if (mins != 0) {
-        lcd.print(mins);
-        lcd.print(F("m"));
-      }
-      else {
-        lcd.print(secs);
-        lcd.print(F("s"));
-      }
+  #ifdef NODE_SENSORS
+    sensors.init();
+    display = sensors.getDisplay();
+  #else
+    // find what's attached to the ports. A warm boot only checks the I2C devices
+    // are still there and does a full start up if they aren't.
+    uint8_t types[4];
+    Autodetect ad;
+
+    if (warmBoot && bootPortsMatch() && ad.checkI2CDevices(bootRecord.portTypes) == 0) {
+      memcpy(types, bootRecord.portTypes, 4);
+    }
+    else {
+      warmBoot = false;
+      detectSensors(types);
+    }
+
+    for (byte p = 0; p < 4; p++) {
+      if (types[p] == SENSOR_LCD && !display) display = new LCDDisplay(p + 1);
     }
   #endif
+
+  if (display) {
+    lcd = &display->lcd;
+    display->init();
+
+    mins = myInterval / 6;
+    secs = (myInterval % 6) * 10;
+
+    lcd->print(F("HeatHack v" VERSION DEBUG_INDICATOR));
+    lcd->setCursor(0,1);
+    lcd->print(F("G:"));
+    lcd->print(myGroupID);
+    lcd->print(F(" N:"));
+    lcd->print(nodeID());
+    lcd->print(F(" I:"));
+    if (mins != 0) {
+      lcd->print(mins);
+      lcd->print(F("m"));
+    }
+    else {
+      lcd->print(secs);
+      lcd->print(F("s"));
+    }
+  }
   
   Serial.begin(BAUD_RATE);
   
@@ -303,12 +241,30 @@ void setup() {
   // power down
   rf12_sleep(RF12_SLEEP);
 
-  configConsole();
+  #ifndef NODE_SENSORS
+    uint8_t bootPorts[4];
+    memcpy(bootPorts, portSensor, 4);
+  #endif
+
+  if (!warmBoot) configConsole();
 
+  #ifndef NODE_SENSORS
+    // probe again if any ports were changed in the console
+    if (memcmp(bootPorts, portSensor, 4) != 0) detectSensors(types);
+
+    sensors.build(types);
+    sensors.init();
+    memcpy(bootRecord.portTypes, types, 4);
+  #endif
+
+  Serial.print(F("Boot "));
+  Serial.print(bootRecord.bootCount);
+  if (warmBoot) Serial.print(F(" (warm)"));
+  Serial.println();
   Serial.print(F("Using group id "));
   Serial.print(myGroupID);
   Serial.print(F(" and node id "));
-  Serial.print(myNodeID);
+  Serial.print(nodeID());
   Serial.println();
   Serial.print(F("Transmit interval is "));
   mins = myInterval / 6;
@@ -333,66 +289,57 @@ void setup() {
   Serial.println();
   serialFlush();
 
-  #if LCD_PORT
+  if (display) {
     Serial.print(F("* LCD on port "));
-    Serial.print(LCD_PORT);
-    Serial.print(isLCDEnabled ? ". Detected" : ". Not present");
+    Serial.print(display->getPort());
     Serial.println();
     serialFlush();    
-  #endif
-
-  #if DS18B_PORT
-
-    ds18b.init();
-
-    Serial.print(F("* DS18B on port "));
-    Serial.print(DS18B_PORT);
-    Serial.print(F(". Number of sensors: "));
-    Serial.print(ds18b.getNumDevices());
-    Serial.println();
-    serialFlush();
-  #endif
+  }
 
-  #if DHT_PORT    
+  #ifndef NODE_SENSORS
+  for (uint8_t i = 0; i < sensors.getNumSensors(); i++) {
+    Sensor* sensor = sensors.getSensor(i);
 
-    dht.init();
+    Serial.print(F("* "));
 
-    Serial.print(F("* DHT on port "));
-    Serial.print(DHT_PORT);
-    Serial.print(F(". Type: "));
-    if (dht.getType() == SENSOR_NONE) {
-      Serial.print(F("no device present"));
-    }
-    else {
-      Serial.print(dht.getType());
+    switch (sensors.getType(i)) {
+      case SENSOR_DS18B:
+        Serial.print(F("DS18B"));
+        break;
+      case SENSOR_DHT11:
+      case SENSOR_DHT22:
+        Serial.print(F("DHT"));
+        Serial.print(sensors.getType(i));
+        break;
+      case SENSOR_HYT131:
+        Serial.print(F("HYT131"));
+        break;
+      case SENSOR_BMP085:
+        Serial.print(F("BMP085"));
+        break;
+      case SENSOR_LDR:
+        Serial.print(F("LDR"));
+        break;
+      case SENSOR_PIR:
+        Serial.print(F("PIR"));
+        break;
     }
-    Serial.println();
-    serialFlush();
-  #endif
 
-  #if HYT131_PORT
-    Serial.print(F("* HYT131 on port "));
-    Serial.print(HYT131_PORT);
-    Serial.println();  
-    serialFlush();
-  #endif
+    Serial.print(F(" on port "));
+    Serial.print(sensor->getPort());
 
-  #if LDR_PORT
-    Serial.print(F("* LDR on port "));
-    Serial.print(LDR_PORT);
+    if (sensors.getType(i) == SENSOR_DS18B) {
+      Serial.print(F(". Number of sensors: "));
+      Serial.print(((SensorDriver<DS18B>*) sensor)->driver.getNumDevices());
+    }
     Serial.println();
     serialFlush();
+  }
   #endif
-  
-  #if PIR_PORT
-    pir.digiWrite(PIR_PULLUP);
 
-    Serial.print(F("* PIR on port "));
-    Serial.print(PIR_PORT);
-    Serial.println();
-    serialFlush();
-  #endif
-  
+  Serial.print(F("Measuring takes about "));
+  Serial.print(sensors.measureTime());
+  Serial.println(F("ms"));
   serialFlush();
 
   // turn off serial if not debugging and not verbose
@@ -401,48 +348,32 @@ void setup() {
   #endif
 
   // reinitialise LCD in case config has upset it (e.g. probing ports)
-  #if LCD_PORT
-    if (isLCDEnabled) {
-      pinMode(LCD_PORT + 13, OUTPUT);
-      lcd.begin(LCD_WIDTH, LCD_HEIGHT);
-      lcd.noBacklight();
-    }
-  #endif
+  if (display) display->init();
 
-  // calculate transmit power to use
-  rf12_sleep(RF12_WAKEUP);
-  transmitPower = findMinTransmitPower();
-  if (transmitPower == NO_RESPONSE) transmitPower = 0;
+  // calculate transmit power to use, unless it's known from the last boot
+  if (warmBoot) {
+    transmitPower = bootRecord.transmitPower;
+  }
+  else {
+    rf12_sleep(RF12_WAKEUP);
+    transmitPower = findMinTransmitPower();
+    if (transmitPower == NO_RESPONSE) transmitPower = 0;
 
-  // power down radio
-  rf12_sleep(RF12_SLEEP);
+    // power down radio
+    rf12_sleep(RF12_SLEEP);
+  }
+
+  enableConsoleWake();
 }
 
 
 /////////////////////////////////////////////////////////////////////
 void loop() {
 
-  #if PIR_PORT
-    static bool pirStarted = false;
-
-    // don't want interrupts from PIR upsetting things
-    if (pirStarted) pir.disableInterrupt();
-  #endif
-
+  checkConsoleWake();
   doMeasure();
   doReport();
-
-  #if LCD_PORT
-    displayReadingsOnLCD();
-  #endif
-
-  #if PIR_PORT
-    if (pirStarted || millis() >  (1000L * PIR_STARTUP_SECS)) {
-      pirStarted = true;
-      pir.enableInterrupt();
-    }
-  #endif    
-
+  updateBootRecord();
+  displayReadingsOnLCD();
   doSleep();
-}  
-
+}
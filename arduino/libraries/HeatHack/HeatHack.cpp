@@ -8,7 +8,8 @@ const char* HHSensorTypeNames[] = {
 	"Movement",
 	"Pressure",
 	"Sound",
-	"Low Battery"
+	"Low Battery",
+	"Sample Time"
 };
 
 const char* HHSensorUnitNames[] = {
@@ -19,7 +20,8 @@ const char* HHSensorUnitNames[] = {
 	"M",
 	"b",
 	"d",
-    "B"
+    "B",
+	"s"
 };
 
 // Table indicating which sensor types send their reading as a literal integer
@@ -32,5 +34,6 @@ bool HHSensorTypeIsInt[] = {
 	true,
 	false,
 	false,
+	true,
 	true
 };
@@ -91,10 +91,15 @@
 #define EEPROM_PORT2    (HH_EEPROM_BASE + 3)   // type of sensor attached to port 2
 #define EEPROM_PORT3    (HH_EEPROM_BASE + 4)   // type of sensor attached to port 3
 #define EEPROM_PORT4    (HH_EEPROM_BASE + 5)   // type of sensor attached to port 4
+#define EEPROM_BOOT_RECORD (HH_EEPROM_BASE + 6) // warm boot record, 9 bytes (see HeatHackShared.h)
+#define EEPROM_DS18B_TABLE (HH_EEPROM_BASE + 0x10) // cached DS18B device tables, one per port (see HeatHackSensors.h)
+#define EEPROM_EXT_NODE (HH_EEPROM_BASE + 0x98) // extended node id, 2 bytes
+#define EEPROM_SECURE_BOOTS (HH_EEPROM_BASE + 0x9A) // boot count for secured packets' counters, 2 bytes (see HeatHackSecure.h)
 
 // flags stored in EEPROM_FLAGS
 #define FLAG_ACK 0x01
 #define FLAG_VERBOSE 0x02
+#define FLAG_STATS 0x04    // receiver prints its statistics periodically
 
 // per-port sensor types
 #define SENSOR_NONE  1   // no sensor attached
@@ -104,14 +109,17 @@
 #define SENSOR_DHT22 22
 #define SENSOR_DS18B 18
 #define SENSOR_HYT131 131
+#define SENSOR_BMP085 85  // pressure plug
 #define SENSOR_LCD   5
 #define SENSOR_LDR   3   // light-dependent resistor between AIO and GND pins
 #define SENSOR_PULSE 4   // pulsed input on DIO pin (e.g. hall-effect switch or photo-detector for meter reading)
 #define SENSOR_RTC   6   // Real time clock
+#define SENSOR_PIR   7   // PIR motion sensor on DIO pin
+#define SENSOR_ROOM  8   // room board's LDR on AIO and PIR on DIO pins (its HYT131 is autodetected on the other port)
 
 // max sensor type number that can be entered in config console
 #define SENSOR_MIN 1
-#define SENSOR_MAX 4
+#define SENSOR_MAX 8
 
 #define RECEIVER_NODE_ID 1
 
@@ -151,6 +159,15 @@
 #define NODE_MAX 30
 #endif
 
+// Extended node ids go above NODE_MAX, for more nodes than the RF12's 5 bit id allows.
+// An extended node uses EXT_RF12_NODE_ID as its RF12 id and sends its packets to the
+// receiver with an HHExtHeader holding its real id in front of the data.
+#ifndef EXT_NODE_MAX
+#define EXT_NODE_MAX 1023
+#endif
+
+#define EXT_RF12_NODE_ID 31
+
 // 10 secs min
 #ifndef INTERVAL_MIN
 #define INTERVAL_MIN 1
@@ -161,16 +178,65 @@
 #define INTERVAL_MAX 255
 #endif
 
+/**
+ * Config console settings
+ */
+// seconds to wait for 'c' to be pressed. Only waits if a serial adapter's connected.
+#ifndef CONSOLE_WAIT_SECS
+#define CONSOLE_WAIT_SECS 10
+#endif
+
+// wake a sleeping node when a key's pressed, so the console can be entered at any time.
+// Uses a pin-change interrupt on the serial RX pin.
+#ifndef CONSOLE_WAKE
+#define CONSOLE_WAKE true
+#endif
+
+#define CONSOLE_RX_PIN 0
+
 /**
  * Acknowledgement and retry settings
  */
-#define ACK_TIME        10  // number of milliseconds to wait for an ack
+#define ACK_TIME        15  // number of milliseconds to wait for an ack, long enough for a repeater's (see HeatHackRepeater)
 #define RETRY_PERIOD    1000  // how soon to retry if ACK didn't come in
 #define RETRY_LIMIT     5   // maximum number of times to retry
 #define SUCCESSIVE_RETRY_THRESHOLD 4 // number of doReports that must fail on 1st try before recalcing min transmit power
 #define NO_RESPONSE     255  // value returned by findMinTransmitPower indicating receiver couldn't be contacted
 #define POWER_RETRY_PERIOD    100  // how soon to retry when determining min transmit power
 
+// in an ack's data, followed by the receiver's millis() (4 bytes). Comes before any
+// ACK_TRACE_REQUEST.
+#define ACK_TIME_SYNC 'S'
+
+// in an ack's data, followed by a channel (1 byte) and when the group moves to it by
+// the receiver's clock (4 bytes). See HeatHackChannel.h.
+#define ACK_CHANNEL 'C'
+
+// in an ack's data, followed by the node's data rate step (1 byte). See
+// HeatHackRate.h.
+#define ACK_RATE 'R'
+
+/**
+ * Time sync settings
+ * The receiver sends its clock in its acks and nodes keep track of it, so each packet
+ * can say when its readings were taken by the receiver's clock. The hub can then
+ * timestamp the readings however late they arrive. See receiverTime() in
+ * HeatHackShared.h.
+ */
+#ifndef TIME_SYNC
+	#if defined(__AVR_ATtiny84__)
+		#define TIME_SYNC false
+	#else
+		#define TIME_SYNC true
+	#endif
+#endif
+
+#define TIME_SYNC_MIN_MS 5000        // shortest time between acks that's used to measure the clock rate
+#define TIME_SYNC_VALID_MS 3600000   // how long the clock is trusted for without an ack
+
+// oldest sample time the receiver reports. Anything older is from before it restarted.
+#define MAX_SAMPLE_AGE_SECS 3600
+
 // set the sync mode to 2 if the fuses are still the Arduino default
 // mode 3 (full powerdown) can only be used with 258 CK startup fuses
 #define RADIO_SYNC_MODE 2
@@ -190,6 +256,35 @@
 /**
  * Definitions for the data packet
  */
+
+// Packets sent directly to the receiver (RF12_HDR_DST) rather than broadcast start
+// with this header, as the RF12 header then holds the receiver's id instead of the
+// sender's. Used for extended nodes' data, event traces and repeaters' packets. The
+// receiver's ack to one of these is broadcast with the node id in its first two bytes.
+struct HHExtHeader {
+	uint8_t kind;       // HH_PACKET_xxx
+	uint16_t nodeId;
+};
+
+#define HH_PACKET_DATA     'D'   // followed by a HeatHackData
+#define HH_PACKET_TRACE    'T'   // followed by TraceEvents (see HeatHackTrace.h)
+#define HH_PACKET_REPEATED 'R'   // from a repeater, followed by one or more HHRepeatedHeaders
+
+// A node's packet passed on by a repeater (see HeatHackRepeater), followed by the
+// node's HeatHackData. The HHExtHeader's nodeId is the repeater's.
+struct HHRepeatedHeader {
+	uint16_t nodeId;    // the node that sent the data
+	uint8_t hops;       // number of repeaters it's been through
+	uint8_t size;       // size of the HeatHackData that follows
+};
+
+// largest packet that can be sent, which is less for an RFM69 in native mode as
+// the whole packet has to fit in its FIFO. A HeatHackData fits either way.
+#if RF69_NATIVE || RF69_NATIVE_FAST
+	#define HH_MAX_PACKET RF69_NATIVE_MAXDATA
+#else
+	#define HH_MAX_PACKET RF12_MAXDATA
+#endif
  
 // Sensor types
 namespace HHSensorType {
@@ -199,9 +294,10 @@ namespace HHSensorType {
         HUMIDITY    = 2,	// percentage as a decimal to 0.1 degrees
         LIGHT       = 3,	// int value, 0 (darkest) to 255 (brightest)
         MOTION      = 4,	// integer count of motion events since last transmit
-        PRESSURE    = 5,	// decimal value, as yet undefined but expect millibars
+        PRESSURE    = 5,	// millibars as a decimal to 0.1 mb
         SOUND       = 6,	// decimal value, as yet undefined but expect dB
-        LOW_BATT    = 7		// int value, 0 - battery OK, 1 - low battery
+        LOW_BATT    = 7,	// int value, 0 - battery OK, 1 - low battery
+        SAMPLE_TIME = 8		// not a sensor: receiver's clock in seconds (low 16 bits) when the readings were taken
     };
 }
 
@@ -0,0 +1,86 @@
+#ifndef HEATHACK_BMP085_H
+#define HEATHACK_BMP085_H
+
+#include <Arduino.h>
+
+/*
+ * These includes won't get picked up properly due to the way the Arduino IDE
+ * builds the include directory list for the compiler. Instead, these includes
+ * need to be put in the main program file before the #include <HeatHackBMP085.h> line.
+*/
+#include <JeeLib.h>
+#include <PortsBMP085.h>
+#include "HeatHack.h"
+#include "HeatHackSensors.h"
+
+// pressure oversampling, 0 (1 sample, 4.5ms) to 3 (8 samples, 25.5ms)
+#ifndef BMP085_OVERSAMPLING
+	#define BMP085_OVERSAMPLING 3
+#endif
+
+// temperature conversion time in ms
+#define BMP085_TEMP_TIME_MS 5
+
+/**********************************************************************************
+ * BMP085 pressure sensor on the I2C bus, as on the JeeLabs pressure plug.
+ * Reports pressure in tenths of a millibar.
+ *
+ * The pressure reading has to be compensated using the sensor's temperature, so two
+ * conversions are needed. The temperature conversion is started in powerOn() and
+ * read in startConversion(), which then starts the pressure conversion, so the node
+ * sleeps through both along with the other sensors. The compensation is done with
+ * the integer arithmetic from the datasheet by JeeLib's BMP085 class.
+ */
+class BMP085Sensor : public SensorBase<BMP085Sensor> {
+	PortI2C i2c;
+	BMP085 bmp;
+
+public:
+	BMP085Sensor(byte portNum)
+		: SensorBase<BMP085Sensor>(portNum), i2c(portNum), bmp(i2c, BMP085_OVERSAMPLING) {
+	}
+
+	void init(void) {
+		bmp.getCalibData();
+	}
+
+	uint16_t powerUpTime(void) {
+		return BMP085_TEMP_TIME_MS;
+	}
+
+	uint16_t conversionTime(void) {
+		// 1.5ms + 3ms per sample, rounded up
+		return 2 + (3 << BMP085_OVERSAMPLING);
+	}
+
+	uint16_t busTime(void) {
+		return 2;
+	}
+
+	void powerOn(void) {
+		bmp.startMeas(BMP085::TEMP);
+	}
+
+	void startConversion(void) {
+		bmp.getResult(BMP085::TEMP);
+		bmp.startMeas(BMP085::PRES);
+	}
+
+	void readResult(HeatHackData& packet) {
+		int16_t temp;
+		int32_t pressure;
+
+		bmp.getResult(BMP085::PRES);
+		bmp.calculate(temp, pressure);
+
+		HHReading reading;
+		reading.setPort(portNum);
+		reading.setSensor(1);
+		reading.sensorType = HHSensorType::PRESSURE;
+		// Pa to tenths of a millibar
+		reading.encodedReading = (pressure + 5) / 10;
+		packet.addReading(reading);
+	}
+};
+
+#endif
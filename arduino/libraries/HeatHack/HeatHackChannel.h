@@ -0,0 +1,109 @@
+#ifndef HEATHACK_CHANNEL_H
+#define HEATHACK_CHANNEL_H
+
+#include <Arduino.h>
+#include "HeatHack.h"
+
+/*
+ * Channel plan, for moving the group off a channel that something else in the
+ * building is using, instead of every node turning its power up and retrying.
+ *
+ * The plan is a few frequencies in the 868 MHz band. Every radio starts on channel
+ * 0, jeelib's default frequency, which is also the rendezvous channel.
+ *
+ * The receiver keeps an average of how busy each channel is from the RSSI bit in
+ * the radio's status, which is set while it hears a signal above -91 dBm. Every
+ * CHANNEL_SURVEY_MS it samples one channel for a few ms, its own or one of the
+ * others in turn. Every CHANNEL_CHECK_SECS it also works out how many packets it's
+ * lost on its channel. If the channel's busy or losing packets and another's much
+ * quieter, it picks a time CHANNEL_NOTICE_SECS ahead by its clock and puts it in
+ * every ack until then (ACK_CHANNEL). Nodes and repeaters move at that time by the
+ * receiver's clock, which they keep from the acks.
+ *
+ * A node that misses the move stops getting acks. When all the tries at a report
+ * fail it goes back to the rendezvous channel. While the group's on another channel
+ * the receiver, and any repeaters, listen on the rendezvous channel for the first
+ * CHANNEL_RENDEZVOUS_LISTEN_MS of every CHANNEL_RENDEZVOUS_MS by the receiver's
+ * clock, and their acks there say where the group is. A lost node times its tries
+ * to land in that window. If it's gone so long without an ack that it no longer
+ * trusts its copy of the clock, it can only hope to hit the window.
+ *
+ * Every radio in the group has to use the plan, and it needs TIME_SYNC so the
+ * Micro can't. It's off unless the sketch defines CHANNEL_PLAN as true before
+ * including the HeatHack headers.
+ */
+#ifndef CHANNEL_PLAN
+	#define CHANNEL_PLAN false
+#endif
+
+#if CHANNEL_PLAN
+
+#if !TIME_SYNC
+	#error The channel plan needs TIME_SYNC for the rendezvous
+#endif
+
+// RF12 frequency words in the 868 MHz band, 5 kHz steps from 860 MHz. The default
+// is 868.0, 868.25 and 868.5 MHz, which keeps to the 868.0-868.6 MHz sub-band.
+#ifndef CHANNEL_FREQUENCIES
+	#define CHANNEL_FREQUENCIES 1600, 1650, 1700
+#endif
+
+static const uint16_t channelFrequency[] = { CHANNEL_FREQUENCIES };
+#define CHANNEL_COUNT (sizeof(channelFrequency) / sizeof(channelFrequency[0]))
+
+#define CHANNEL_RENDEZVOUS_MS 10000
+#define CHANNEL_RENDEZVOUS_LISTEN_MS 400
+
+// the receiver's survey: how often it samples a channel, and how
+#define CHANNEL_SURVEY_MS 2000
+#define CHANNEL_SAMPLES 64
+#define CHANNEL_SAMPLE_US 100
+#define CHANNEL_SETTLE_US 500    // for the radio's PLL and RSSI to settle after retuning
+
+// the receiver's decision to move. Noise is the fraction of RSSI samples that heard
+// a signal, in 256ths.
+#define CHANNEL_CHECK_SECS 600
+#define CHANNEL_NOTICE_SECS 300
+#define CHANNEL_LOSS_PERCENT 10  // move if more packets than this are lost
+#define CHANNEL_MIN_PACKETS 20   // fewer than this and the loss doesn't count
+#define CHANNEL_NOISE_BUSY 64    // or if the noise is more than this
+#define CHANNEL_NOISE_MARGIN 32  // and another channel's quieter by this much
+
+// a secondary receiver that's heard nothing for this long tries the next channel
+#define CHANNEL_SCAN_SECS 120
+
+// the RSSI bit in the RFM12's status word, which rf69_control copies
+#define CHANNEL_RSSI_BIT 0x0100
+
+static uint8_t groupChannel = 0;         // the group's channel, as far as this radio knows
+static uint8_t channelTuned = 0;         // the channel the radio's tuned to
+static bool channelMovePending = false;
+static uint8_t channelNext;              // the channel the group's moving to
+static uint32_t channelMoveAt;           // when, by the receiver's clock
+static bool channelLost = false;         // gone back to the rendezvous channel
+
+// takes effect the next time the receiver's turned on
+static void tuneChannel(uint8_t channel) {
+	rf12_control(0xA000 | channelFrequency[channel]);
+	channelTuned = channel;
+}
+
+// noise on the channel the radio's tuned to, in 256ths. The receiver must have been
+// stopped (see radioCanRetune), and it's left on afterwards.
+static uint8_t channelSampleNoise(void) {
+	rf12_recvDone();
+	delayMicroseconds(CHANNEL_SETTLE_US);
+
+	uint16_t busy = 0;
+	for (uint8_t i = 0; i < CHANNEL_SAMPLES; i++) {
+		if (rf12_control(0x0000) & CHANNEL_RSSI_BIT) busy++;
+		delayMicroseconds(CHANNEL_SAMPLE_US);
+	}
+
+	busy = busy * 256 / CHANNEL_SAMPLES;
+	return busy > 255 ? 255 : busy;
+}
+
+#endif
+
+#endif
@@ -0,0 +1,89 @@
+#ifndef HEATHACK_CLOCK_H
+#define HEATHACK_CLOCK_H
+
+#include <Arduino.h>
+
+/*
+ * Runs the processor on a slower clock while the node is awake but isn't doing
+ * anything that depends on the clock speed, e.g. working out and filtering
+ * readings, talking to I2C sensors and updating the LCD. The awake current goes
+ * down roughly in line with the clock, so dividing it by 8 saves most of it.
+ *
+ * The system clock prescaler (CLKPR) divides the clock by 8 and at the same time
+ * timer 0's prescaler is changed from 64 to 8, so timer 0 still ticks every 4us.
+ * That keeps millis(), micros() and delay() correct at either speed, and Sleepy's
+ * adjustment of the millis count works as normal since the watchdog has its own clock.
+ *
+ * Things that count processor cycles still run 8 times slower on the slow clock:
+ * delayMicroseconds(), the DHT's pulse timing, OneWire and the serial port's baud
+ * rate. Code that relies on them puts a FullClock on the stack while it runs, and the
+ * radio and serial port are only used on the full clock. The sensors that time
+ * delayMicroseconds() while measuring (the DHT, DS18B and LDR) do so, and the
+ * rest only use it for the I2C bus and LCD, where a longer wait is harmless.
+ *
+ * Only the ATmega's standard Arduino core is supported. On the tiny84 (JNMicro)
+ * the clock is left alone and these do nothing.
+ */
+#if !defined(__AVR_ATtiny84__)
+	#define CLOCK_SCALING true
+#endif
+
+// CLKPR setting for divide by 8
+#define CLOCK_SLOW_DIV 3
+
+// timer 0 prescaler of 64 (the Arduino default) and 8
+#define CLOCK_TIMER0_FULL (_BV(CS01) | _BV(CS00))
+#define CLOCK_TIMER0_SLOW _BV(CS01)
+#define CLOCK_TIMER0_MASK (_BV(CS02) | _BV(CS01) | _BV(CS00))
+
+static bool clockIsSlow = false;
+
+// switch the processor clock and timer 0 prescalers together so that timer 0
+// doesn't change speed
+static inline void setClock(bool slow) {
+#if CLOCK_SCALING
+	if (slow == clockIsSlow) return;
+
+	uint8_t oldSREG = SREG;
+	cli();
+	CLKPR = _BV(CLKPCE);
+	CLKPR = slow ? CLOCK_SLOW_DIV : 0;
+	TCCR0B = (TCCR0B & ~CLOCK_TIMER0_MASK) | (slow ? CLOCK_TIMER0_SLOW : CLOCK_TIMER0_FULL);
+	SREG = oldSREG;
+
+	clockIsSlow = slow;
+#endif
+}
+
+// runs the processor on the slow clock until it goes out of scope
+class SlowClock {
+	bool wasSlow;
+
+public:
+	SlowClock()
+		: wasSlow(clockIsSlow) {
+		setClock(true);
+	}
+
+	~SlowClock() {
+		setClock(wasSlow);
+	}
+};
+
+// runs the processor on the full clock until it goes out of scope, then goes back
+// to whichever clock it was on before
+class FullClock {
+	bool wasSlow;
+
+public:
+	FullClock()
+		: wasSlow(clockIsSlow) {
+		setClock(false);
+	}
+
+	~FullClock() {
+		setClock(wasSlow);
+	}
+};
+
+#endif
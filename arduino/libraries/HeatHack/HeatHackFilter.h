@@ -0,0 +1,196 @@
+#ifndef HEATHACK_FILTER_H
+#define HEATHACK_FILTER_H
+
+#include <Arduino.h>
+#include <avr/pgmspace.h>
+#include "HeatHack.h"
+
+/*
+ * Integer-only filtering of sensor readings on the node, to stop glitches and
+ * noise being sent to the logger.
+ *
+ * Each reading (sensor type, port and sensor number) gets its own channel, which
+ * goes through three stages:
+ *  1. spike rejection - a reading further than maxStep from the last accepted
+ *     reading is dropped. If FILTER_MAX_REJECTS readings in a row are dropped
+ *     then the value really has moved, so the next one is accepted and the
+ *     channel restarts from it.
+ *  2. median of the last median readings (up to FILTER_MEDIAN_SIZE), which
+ *     removes single odd readings that are too small to count as spikes.
+ *  3. an exponentially weighted moving average with a weight of 1/2^ewmaShift
+ *     on the newest reading. 0 turns it off.
+ *
+ * The stages used are set per reading type in FILTER_SETTINGS. A stage's
+ * setting of 0 turns it off and readings of a type with everything off aren't
+ * given a channel.
+ */
+
+// number of readings that can be filtered. Any more are passed through unfiltered.
+#ifndef FILTER_CHANNELS
+	#define FILTER_CHANNELS 8
+#endif
+
+// max number of readings a median is taken over
+#ifndef FILTER_MEDIAN_SIZE
+	#define FILTER_MEDIAN_SIZE 3
+#endif
+
+// number of successive spikes dropped before the new level is accepted
+#ifndef FILTER_MAX_REJECTS
+	#define FILTER_MAX_REJECTS 2
+#endif
+
+// fractional bits kept by the moving average
+#define FILTER_EWMA_FRAC_BITS 4
+
+#define FILTER_UNUSED 0xFF
+
+struct FilterSettings {
+	uint16_t maxStep;   // in the reading's units (tenths for decimal readings)
+	uint8_t median;     // number of readings
+	uint8_t ewmaShift;
+};
+
+// settings for each HHSensorType
+#ifndef FILTER_SETTINGS
+	#define FILTER_SETTINGS \
+		{   0, 0, 0 },  /* TEST */ \
+		{  50, 3, 1 },  /* TEMPERATURE - 5 degrees */ \
+		{ 150, 3, 1 },  /* HUMIDITY - 15% */ \
+		{   0, 3, 0 },  /* LIGHT - can change quickly so no spike rejection */ \
+		{   0, 0, 0 },  /* MOTION - a count, so not filtered */ \
+		{ 100, 3, 1 },  /* PRESSURE - 10mb */ \
+		{   0, 0, 0 },  /* SOUND */ \
+		{   0, 0, 0 }   /* LOW_BATT */
+#endif
+
+const FilterSettings filterSettings[] PROGMEM = { FILTER_SETTINGS };
+
+// state kept for each reading, 14 bytes
+struct FilterChannel {
+	uint8_t header;     // header of the reading this channel is for (type, port and sensor)
+	uint8_t count;      // number of readings in the ring
+	uint8_t next;       // next ring position to fill
+	uint8_t rejects;    // spikes dropped in a row
+	int16_t ring[FILTER_MEDIAN_SIZE];
+	int32_t ewma;       // average << FILTER_EWMA_FRAC_BITS
+};
+
+
+class ReadingFilter {
+	FilterChannel channels[FILTER_CHANNELS];
+
+public:
+	ReadingFilter() {
+		for (uint8_t i = 0; i < FILTER_CHANNELS; i++) {
+			channels[i].header = FILTER_UNUSED;
+		}
+	}
+
+	// filter the readings in a packet. Spikes are removed from the packet.
+	void apply(HeatHackData& packet) {
+		uint8_t kept = 0;
+
+		for (uint8_t i = 0; i < packet.numReadings; i++) {
+			if (filter(packet.readings[i])) {
+				packet.readings[kept++] = packet.readings[i];
+			}
+		}
+
+		packet.numReadings = kept;
+	}
+
+	// filter a single reading in place. Returns false if it's a spike and should be dropped.
+	bool filter(HHReading& reading) {
+		if (reading.sensorType >= sizeof(filterSettings) / sizeof(FilterSettings)) return true;
+
+		FilterSettings settings;
+		memcpy_P(&settings, &filterSettings[reading.sensorType], sizeof(settings));
+
+		if (settings.maxStep == 0 && settings.median <= 1 && settings.ewmaShift == 0) return true;
+
+		FilterChannel* channel = findChannel(reading.header);
+		if (!channel) return true;
+
+		int16_t value = reading.encodedReading;
+
+		// 1. spike rejection
+		if (channel->count > 0 && settings.maxStep != 0) {
+			int16_t last = channel->ring[(channel->next + FILTER_MEDIAN_SIZE - 1) % FILTER_MEDIAN_SIZE];
+			uint16_t step = abs(value - last);
+
+			if (step > settings.maxStep) {
+				if (channel->rejects < FILTER_MAX_REJECTS) {
+					channel->rejects++;
+					return false;
+				}
+
+				// level has really changed, so start again from here
+				channel->count = 0;
+			}
+		}
+		channel->rejects = 0;
+
+		channel->ring[channel->next] = value;
+		channel->next = (channel->next + 1) % FILTER_MEDIAN_SIZE;
+		if (channel->count < FILTER_MEDIAN_SIZE) channel->count++;
+
+		// 2. median
+		if (settings.median > 1) {
+			value = median(channel, min(settings.median, channel->count));
+		}
+
+		// 3. moving average
+		if (settings.ewmaShift != 0) {
+			int32_t scaled = (int32_t) value << FILTER_EWMA_FRAC_BITS;
+
+			if (channel->count == 1) channel->ewma = scaled;
+			else channel->ewma += (scaled - channel->ewma) >> settings.ewmaShift;
+
+			value = (channel->ewma + (1 << (FILTER_EWMA_FRAC_BITS - 1))) >> FILTER_EWMA_FRAC_BITS;
+		}
+
+		reading.encodedReading = value;
+		return true;
+	}
+
+private:
+	// the channel for a reading, allocating one if it's new. 0 if they're all in use.
+	FilterChannel* findChannel(uint8_t header) {
+		FilterChannel* unused = 0;
+
+		for (uint8_t i = 0; i < FILTER_CHANNELS; i++) {
+			if (channels[i].header == header) return &channels[i];
+			if (!unused && channels[i].header == FILTER_UNUSED) unused = &channels[i];
+		}
+
+		if (unused) {
+			unused->header = header;
+			unused->count = 0;
+			unused->next = 0;
+			unused->rejects = 0;
+		}
+		return unused;
+	}
+
+	// median of the n most recent readings in the channel's ring
+	static int16_t median(FilterChannel* channel, uint8_t n) {
+		int16_t sorted[FILTER_MEDIAN_SIZE];
+
+		// insertion sort of the last n readings
+		for (uint8_t i = 0; i < n; i++) {
+			int16_t v = channel->ring[(channel->next + FILTER_MEDIAN_SIZE - 1 - i) % FILTER_MEDIAN_SIZE];
+			uint8_t j = i;
+
+			while (j > 0 && sorted[j-1] > v) {
+				sorted[j] = sorted[j-1];
+				j--;
+			}
+			sorted[j] = v;
+		}
+
+		return sorted[n / 2];
+	}
+};
+
+#endif
@@ -0,0 +1,293 @@
+#ifndef HEATHACK_NODE_H
+#define HEATHACK_NODE_H
+
+#include <Arduino.h>
+
+/*
+ * These includes won't get picked up properly due to the way the Arduino IDE
+ * builds the include directory list for the compiler. Instead, these includes
+ * need to be put in the main program file before the #include <HeatHackNode.h> line.
+ *
+ * The LCD is only available if PortsLCD.h is included first, the room board
+ * sensors if HeatHackRoomBoard.h is included first and the pressure sensor if
+ * HeatHackBMP085.h is included first.
+*/
+#include <JeeLib.h>
+#include "HeatHack.h"
+#include "HeatHackSensors.h"
+
+// pins of a port used by a sensor, for checking for conflicts
+#define NODE_PIN_D 0x01
+#define NODE_PIN_A 0x02
+
+// max number of pin-change interrupt handlers
+#ifdef PINCHANGE_MAX_HANDLERS
+	#define NODE_MAX_PINCHANGE PINCHANGE_MAX_HANDLERS
+#else
+	#define NODE_MAX_PINCHANGE 3
+#endif
+
+
+/**********************************************************************************
+ * A driver on a given port, with what it needs from the port so the Node can check
+ * the configuration when it's compiled.
+ *  PINS       NODE_PIN_x bits for the pins the driver uses
+ *  PINCHANGE  1 if the driver uses a pin-change interrupt
+ *  SINGLETON  1 if there can only be one of the driver on a node
+ */
+template<class Driver, byte PORT, byte PINS, byte PINCHANGE = 0, byte SINGLETON = 0>
+class On : public Driver {
+
+public:
+	enum { port = PORT, pins = PINS, pinChange = PINCHANGE, singleton = SINGLETON };
+
+	On()
+		: Driver(PORT) {
+	}
+};
+
+template<byte PORT> class DHTOn : public On<DHT, PORT, NODE_PIN_D | NODE_PIN_A, DHT_USE_INTERRUPTS> {};
+template<byte PORT> class DS18BOn : public On<DS18B, PORT, NODE_PIN_D | NODE_PIN_A> {};
+
+#ifdef HEATHACK_ROOMBOARD_H
+template<byte PORT> class HYT131On : public On<HYT131Sensor, PORT, NODE_PIN_D | NODE_PIN_A> {};
+template<byte PORT> class LDROn : public On<LDR, PORT, NODE_PIN_A> {};
+template<byte PORT> class PIROn : public On<PIR, PORT, NODE_PIN_D, 1, 1> {};
+#endif
+
+#ifdef HEATHACK_BMP085_H
+template<byte PORT> class BMP085On : public On<BMP085Sensor, PORT, NODE_PIN_D | NODE_PIN_A> {};
+#endif
+
+#ifdef LiquidCrystal_h
+/**********************************************************************************
+ * LCD display on the I2C bus. It takes no readings; the Node just initialises it.
+ */
+class LCDDisplay : public PortI2C {
+
+public:
+	LiquidCrystalI2C lcd;
+
+	LCDDisplay(byte portNum)
+		: PortI2C(portNum), lcd(*this) {
+	}
+
+	inline byte getPort(void) {
+		return portNum;
+	}
+
+	// also used to reinitialise the display if something else has used the port
+	void init(void) {
+		mode2(OUTPUT);
+		lcd.begin(LCD_WIDTH, LCD_HEIGHT);
+		lcd.noBacklight();
+	}
+
+	void powerOn(void) {}
+	void startConversion(void) {}
+	void readResult(HeatHackData& packet) {}
+
+	uint16_t powerUpTime(void) { return 0; }
+	uint16_t conversionTime(void) { return 0; }
+	uint16_t busTime(void) { return 0; }
+};
+
+template<byte PORT> class LCDOn : public On<LCDDisplay, PORT, NODE_PIN_D | NODE_PIN_A> {};
+#endif
+
+// fills an unused place in a Node
+class NoSensor {
+
+public:
+	enum { port = 0, pins = 0, pinChange = 0, singleton = 0 };
+
+	void init(void) {}
+	void powerOn(void) {}
+	void startConversion(void) {}
+	void readResult(HeatHackData& packet) {}
+
+	uint16_t powerUpTime(void) { return 0; }
+	uint16_t conversionTime(void) { return 0; }
+	uint16_t busTime(void) { return 0; }
+};
+
+// true if sensors A and B don't both use a pin
+template<class A, class B>
+struct NoPinClash {
+	enum { value = A::port == 0 || A::port != B::port || !(A::pins & B::pins) };
+};
+
+template<class S>
+struct ValidPort {
+	enum { value = S::port <= 4 };
+};
+
+
+/**********************************************************************************
+ * The sensors on a node, fixed when the sketch is compiled, e.g.
+ *   Node<DHTOn<1>, DS18BOn<3>, LCDOn<2> > node;
+ *
+ * This does the same job as SensorRegistry (HeatHackRegistry.h) without detecting
+ * the sensors at run time. The calls to the drivers are direct so the compiler can
+ * inline them and drop the ones that do nothing, which gives a smaller image. That
+ * matters most on the Micro.
+ *
+ * The configuration is checked when it's compiled. A mistake shows up as an error
+ * about a negative array size, with the typedef's name saying what's wrong.
+ *
+ * measure() overlaps the sensors' waits like SensorRegistry does. Sensors that are
+ * ready at the same time are handled in the order they're listed, so list the ones
+ * with the longest conversions first.
+ */
+template<class S1, class S2 = NoSensor, class S3 = NoSensor, class S4 = NoSensor, class S5 = NoSensor>
+class Node {
+	S1 s1;
+	S2 s2;
+	S3 s3;
+	S4 s4;
+	S5 s5;
+
+	// state of the current measurement, a bit or entry for each sensor
+	uint32_t start;
+	uint8_t started;
+	uint8_t done;
+	uint16_t readAt[5];
+
+	enum {
+		all = (S1::port ? 0x01 : 0) | (S2::port ? 0x02 : 0) | (S3::port ? 0x04 : 0) |
+		      (S4::port ? 0x08 : 0) | (S5::port ? 0x10 : 0)
+	};
+
+	typedef char port_numbers_must_be_1_to_4[
+		(ValidPort<S1>::value && ValidPort<S2>::value && ValidPort<S3>::value &&
+		 ValidPort<S4>::value && ValidPort<S5>::value) ? 1 : -1];
+
+	typedef char two_sensors_use_the_same_pin[
+		(NoPinClash<S1, S2>::value && NoPinClash<S1, S3>::value && NoPinClash<S1, S4>::value &&
+		 NoPinClash<S1, S5>::value && NoPinClash<S2, S3>::value && NoPinClash<S2, S4>::value &&
+		 NoPinClash<S2, S5>::value && NoPinClash<S3, S4>::value && NoPinClash<S3, S5>::value &&
+		 NoPinClash<S4, S5>::value) ? 1 : -1];
+
+	typedef char too_many_pin_change_interrupts[
+		(S1::pinChange + S2::pinChange + S3::pinChange + S4::pinChange + S5::pinChange
+		 + CONSOLE_WAKE <= NODE_MAX_PINCHANGE) ? 1 : -1];
+
+	typedef char sensor_can_only_be_used_once[
+		(S1::singleton + S2::singleton + S3::singleton + S4::singleton + S5::singleton
+		 <= 1) ? 1 : -1];
+
+public:
+	void init(void) {
+		s1.init();
+		s2.init();
+		s3.init();
+		s4.init();
+		s5.init();
+	}
+
+	// take readings from all the sensors
+	void measure(HeatHackData& packet) {
+		start = millis();
+		started = 0;
+		done = 0;
+
+		s1.powerOn();
+		s2.powerOn();
+		s3.powerOn();
+		s4.powerOn();
+		s5.powerOn();
+
+		while (true) {
+			uint16_t next = 0xFFFF;
+
+			step(s1, 0, next, packet);
+			step(s2, 1, next, packet);
+			step(s3, 2, next, packet);
+			step(s4, 3, next, packet);
+			step(s5, 4, next, packet);
+
+			if (done == all) break;
+
+			sleepUntil(start + next);
+		}
+	}
+
+	// rough time in ms that measure() takes
+	uint16_t measureTime(void) {
+		uint16_t slowest = 0;
+
+		slowest = slowestOf(s1, slowest);
+		slowest = slowestOf(s2, slowest);
+		slowest = slowestOf(s3, slowest);
+		slowest = slowestOf(s4, slowest);
+		slowest = slowestOf(s5, slowest);
+
+		return slowest + s1.busTime() + s2.busTime() + s3.busTime() + s4.busTime() + s5.busTime();
+	}
+
+#ifdef LiquidCrystal_h
+	// the first LCD on the node, or 0 if there isn't one
+	LCDDisplay* getDisplay(void) {
+		LCDDisplay* display = 0;
+
+		findDisplay(&s5, display);
+		findDisplay(&s4, display);
+		findDisplay(&s3, display);
+		findDisplay(&s2, display);
+		findDisplay(&s1, display);
+
+		return display;
+	}
+#endif
+
+private:
+	// start the sensor's conversion or read its result if it's time to,
+	// otherwise bring next forward to when it's due
+	template<class S>
+	inline void step(S& s, uint8_t i, uint16_t& next, HeatHackData& packet) {
+		if (!S::port) return;
+
+		uint8_t b = 1 << i;
+		uint16_t now = millis() - start;
+
+		if (!(started & b)) {
+			if (now < s.powerUpTime()) {
+				if (s.powerUpTime() < next) next = s.powerUpTime();
+				return;
+			}
+
+			s.startConversion();
+			started |= b;
+			readAt[i] = (uint16_t) (millis() - start) + s.conversionTime();
+			now = millis() - start;
+		}
+
+		if (!(done & b)) {
+			if (now < readAt[i]) {
+				if (readAt[i] < next) next = readAt[i];
+				return;
+			}
+
+			s.readResult(packet);
+			done |= b;
+		}
+	}
+
+	template<class S>
+	static inline uint16_t slowestOf(S& s, uint16_t slowest) {
+		uint16_t t = s.powerUpTime() + s.conversionTime();
+		return t > slowest ? t : slowest;
+	}
+
+#ifdef LiquidCrystal_h
+	// a pointer to a display converts to LCDDisplay* in preference to void*
+	static inline void findDisplay(LCDDisplay* s, LCDDisplay*& display) {
+		display = s;
+	}
+
+	static inline void findDisplay(const void* s, LCDDisplay*& display) {
+	}
+#endif
+};
+
+#endif
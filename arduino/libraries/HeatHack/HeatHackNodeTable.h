@@ -0,0 +1,101 @@
+#ifndef HEATHACK_NODE_TABLE_H
+#define HEATHACK_NODE_TABLE_H
+
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * The receiver's table of the nodes it's heard from, for telling a resent packet
+ * from a new one and, with SECURE, a replayed one. Extended node ids (see
+ * HeatHack.h) go up to EXT_NODE_MAX, so it's a hash table. Slots are found by
+ * linear probing from the id's hash. Only once the table's full does a new node
+ * take over its home slot, which means a resent packet from the node that lost it
+ * is reported twice, and with SECURE that node's replay window starts again.
+ *
+ * An entry is 2 bytes, so there's room for 256 nodes in 512 bytes of the
+ * ATmega328's RAM. ADAPTIVE_RATE adds a byte for how the node's data rate is
+ * going. With SECURE an entry also keeps the node's packet counter and is 5 bytes
+ * more, and there's room for 128.
+ *
+ * It only needs the C library, so that extras/NodeTableTest.cpp can try it on a PC.
+ */
+#ifndef NODE_TABLE_BITS
+	#if SECURE
+		#define NODE_TABLE_BITS 7
+	#else
+		#define NODE_TABLE_BITS 8
+	#endif
+#endif
+#define NODE_TABLE_SIZE (1 << NODE_TABLE_BITS)
+
+#if NODE_TABLE_BITS > 8
+	#error Slots are numbered with a byte, so the node table has at most 256
+#endif
+#if defined(EXT_NODE_MAX) && EXT_NODE_MAX > 1023
+	#error Node table entries keep node ids in 10 bits
+#endif
+#if ADAPTIVE_RATE && (RATE_UP_PACKETS << 3) > 64
+	#error Node table entries count a run of at most 64 packets
+#endif
+
+// lastSequence before the node's first packet, as sequence numbers are 3 bits
+#define NODE_NO_SEQUENCE 0xF
+
+struct NodeEntry {
+	uint16_t id : 10;           // 0 for an unused slot
+	uint16_t lastSequence : 4;  // last seen sequence number
+	uint16_t rateStep : 2;      // data rate step the node's been given (see HeatHackRate.h)
+#if ADAPTIVE_RATE
+	uint8_t rateRun : 6;        // clean packets in a row at its step
+	uint8_t rateFails : 2;      // times it's moved down a step, each doubling the run to move up
+#endif
+#if SECURE
+	uint32_t counter;           // highest secured packet counter accepted (see HeatHackSecure.h)
+	uint8_t window;             // bit n set if counter - 1 - n has been accepted
+#endif
+};
+
+static NodeEntry nodeTable[NODE_TABLE_SIZE];
+
+// nodes that have taken over another's slot
+static uint16_t nodeEvictions = 0;
+
+// the slot the search for a node starts at. Fibonacci hashing spreads out
+// consecutive ids.
+static uint8_t nodeHome(uint16_t id) {
+	return (uint16_t) (id * 40503u) >> (16 - NODE_TABLE_BITS);
+}
+
+// true if the node's in the table, with slot set to its index. Otherwise slot is
+// where it would go, or a taken slot if the table's full. Slots are never emptied,
+// so the search can stop at the first empty one.
+static bool lookupNode(uint16_t id, uint8_t& slot) {
+	uint8_t home = nodeHome(id);
+
+	for (uint16_t i = 0; i < NODE_TABLE_SIZE; i++) {
+		slot = (home + i) & (NODE_TABLE_SIZE - 1);
+
+		if (nodeTable[slot].id == id) return true;
+		if (nodeTable[slot].id == 0) return false;
+	}
+	return false;
+}
+
+// the index of a node's entry, added to the table if it's new. Only a node whose
+// packet has been checked should be added, as it may take another's slot.
+static uint8_t findNode(uint16_t id) {
+	uint8_t slot;
+	if (lookupNode(id, slot)) return slot;
+
+	if (nodeTable[slot].id != 0) {
+		slot = nodeHome(id);
+		nodeEvictions++;
+	}
+
+	memset(&nodeTable[slot], 0, sizeof(NodeEntry));
+	nodeTable[slot].id = id;
+	nodeTable[slot].lastSequence = NODE_NO_SEQUENCE;
+	return slot;
+}
+
+#endif
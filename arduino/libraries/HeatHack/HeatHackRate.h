@@ -0,0 +1,73 @@
+#ifndef HEATHACK_RATE_H
+#define HEATHACK_RATE_H
+
+#include <Arduino.h>
+#include "HeatHack.h"
+
+/*
+ * Adaptive data rate, so that nodes near the receiver spend less time on the air
+ * and leave more of it for the others.
+ *
+ * Each step up from the default is a faster data rate, with a wider receive
+ * bandwidth to suit it, which costs some sensitivity. The receiver can only listen
+ * at one rate at a time, so it listens at each faster step for RATE_WINDOW_MS at
+ * the end of every RATE_PERIOD_MS by its clock. A node that's been given a faster
+ * step sends the first try at each report in the middle of that step's window.
+ * Nodes at the default rate keep out of the windows.
+ *
+ * The receiver keeps each node's step and tells the node it in every ack
+ * (ACK_RATE). It moves a node up a step after a run of packets with no retries or
+ * losses, if the signal's strong enough for the next step on an RFM69, which
+ * measures it. A retry, a loss or a packet at a slower step than the node was
+ * given moves it down a step, and the run it needs to move up again doubles, up
+ * to 8 times. A node whose try at a faster step isn't acked goes back to the
+ * default rate for its retries, and stays there until an ack gives it a step.
+ *
+ * It needs TIME_SYNC, and the receiver has to be built with it for the nodes to be
+ * given a step. It's off unless the sketch defines ADAPTIVE_RATE as true before
+ * including the HeatHack headers.
+ */
+#ifndef ADAPTIVE_RATE
+	#define ADAPTIVE_RATE false
+#endif
+
+#if ADAPTIVE_RATE
+
+#if !TIME_SYNC
+	#error The adaptive rate needs TIME_SYNC for the windows on the receiver clock
+#endif
+
+// the radio commands for each step: the data rate, 10000 / 29 / (R + 1) kbps, then
+// the receive bandwidth with the LNA gain and RSSI threshold rf12_initialize uses.
+// Step 0 is rf12_initialize's.
+static const uint16_t rateCommands[][2] = {
+	{ 0xC606, 0x94A2 },   // 49.3 kbps, 134 kHz
+	{ 0xC604, 0x9482 },   // 69.0 kbps, 200 kHz
+	{ 0xC603, 0x9462 },   // 86.2 kbps, 270 kHz
+};
+#define RATE_STEPS (sizeof(rateCommands) / sizeof(rateCommands[0]))
+
+// weakest signal for each step on an RFM69, as -dBm * 2 like RF69::rssi
+static const uint8_t rateMinRssi[RATE_STEPS] = { 255, 170, 160 };
+
+// step n's window is the n'th RATE_WINDOW_MS back from the end of the period, so
+// they're clear of the channel plan's rendezvous visits at the start
+#define RATE_PERIOD_MS 10000
+#define RATE_WINDOW_MS 250
+
+// clean packets in a row before a node moves up a step
+#define RATE_UP_PACKETS 8
+
+static uint8_t rateTuned = 0;   // the step the radio's set to
+static uint8_t rateStep = 0;    // a node's step, from the receiver's last ack
+
+// takes effect the next time the receiver or transmitter's turned on
+static void setRate(uint8_t step) {
+	rf12_control(rateCommands[step][0]);
+	rf12_control(rateCommands[step][1]);
+	rateTuned = step;
+}
+
+#endif
+
+#endif
@@ -0,0 +1,223 @@
+#ifndef HEATHACK_REGISTRY_H
+#define HEATHACK_REGISTRY_H
+
+#include <Arduino.h>
+
+/*
+ * These includes won't get picked up properly due to the way the Arduino IDE
+ * builds the include directory list for the compiler. Instead, these includes
+ * need to be put in the main program file before the #include <HeatHackRegistry.h> line.
+*/
+#include <JeeLib.h>
+#include <PinChange.h>
+#include "HeatHack.h"
+#include "HeatHackSensors.h"
+#include "HeatHackRoomBoard.h"
+#include "HeatHackBMP085.h"
+
+// max number of sensor drivers on a node. A room board port has two.
+#ifndef MAX_SENSORS
+	#define MAX_SENSORS 6
+#endif
+
+/**********************************************************************************
+ * Interface to a sensor driver whose type is only known at run time.
+ * See SensorBase in HeatHackSensors.h for what each step does.
+ */
+class Sensor {
+
+public:
+	virtual void init(void) = 0;
+	virtual byte getPort(void) = 0;
+
+	virtual void powerOn(void) = 0;
+	virtual void startConversion(void) = 0;
+	virtual void readResult(HeatHackData& packet) = 0;
+
+	virtual uint16_t powerUpTime(void) = 0;
+	virtual uint16_t conversionTime(void) = 0;
+	virtual uint16_t busTime(void) = 0;
+};
+
+// wraps a driver class in the Sensor interface
+template<class T>
+class SensorDriver : public Sensor {
+
+public:
+	T driver;
+
+	SensorDriver(byte portNum)
+		: driver(portNum) {
+	}
+
+	SensorDriver(byte portNum, byte type)
+		: driver(portNum, type) {
+	}
+
+	void init(void) { driver.init(); }
+	byte getPort(void) { return driver.getPort(); }
+
+	void powerOn(void) { driver.powerOn(); }
+	void startConversion(void) { driver.startConversion(); }
+	void readResult(HeatHackData& packet) { driver.readResult(packet); }
+
+	uint16_t powerUpTime(void) { return driver.powerUpTime(); }
+	uint16_t conversionTime(void) { return driver.conversionTime(); }
+	uint16_t busTime(void) { return driver.busTime(); }
+};
+
+/**********************************************************************************
+ * Holds the drivers for the sensors attached to the node.
+ *
+ * build() creates a driver for each port from its sensor type, as found by
+ * Autodetect or set in the config console (see portSensor[] in HeatHackShared.h),
+ * so the same sketch works whatever is plugged into the ports.
+ *
+ * measure() reads all the sensors together to keep the time spent awake down.
+ * Every sensor is powered up at once, each conversion is started as soon as that
+ * sensor has powered up and the results are collected in the order they're ready.
+ * So the sensors' waits overlap and a measurement takes about as long as the
+ * slowest sensor plus the time spent talking to each one. The node sleeps through
+ * the waits.
+ */
+class SensorRegistry {
+	Sensor* sensors[MAX_SENSORS];
+	uint8_t types[MAX_SENSORS];
+	uint8_t numSensors;
+
+public:
+	SensorRegistry()
+		: numSensors(0) {
+	}
+
+	// create the drivers for the sensor type on each port. The drivers are never freed.
+	void build(const uint8_t typeList[4]) {
+		for (byte p = 0; p < 4; p++) {
+			byte portNum = p + 1;
+
+			switch (typeList[p]) {
+			case SENSOR_DHT11:
+			case SENSOR_DHT22:
+				add(new SensorDriver<DHT>(portNum, typeList[p]), typeList[p]);
+				break;
+			case SENSOR_DS18B:
+				add(new SensorDriver<DS18B>(portNum), SENSOR_DS18B);
+				break;
+			case SENSOR_HYT131:
+				add(new SensorDriver<HYT131Sensor>(portNum), SENSOR_HYT131);
+				break;
+			case SENSOR_BMP085:
+				add(new SensorDriver<BMP085Sensor>(portNum), SENSOR_BMP085);
+				break;
+			case SENSOR_LDR:
+				add(new SensorDriver<LDR>(portNum), SENSOR_LDR);
+				break;
+			case SENSOR_PIR:
+				add(new SensorDriver<PIR>(portNum), SENSOR_PIR);
+				break;
+			case SENSOR_ROOM:
+				add(new SensorDriver<LDR>(portNum), SENSOR_LDR);
+				add(new SensorDriver<PIR>(portNum), SENSOR_PIR);
+				break;
+			}
+		}
+	}
+
+	void init(void) {
+		for (uint8_t i = 0; i < numSensors; i++) {
+			sensors[i]->init();
+		}
+	}
+
+	// take readings from all the sensors
+	void measure(HeatHackData& packet) {
+		uint32_t due[MAX_SENSORS];
+		uint8_t order[MAX_SENSORS];
+		uint32_t start = millis();
+
+		for (uint8_t i = 0; i < numSensors; i++) {
+			sensors[i]->powerOn();
+			due[i] = start + sensors[i]->powerUpTime();
+		}
+
+		// start each conversion once the sensor's powered up
+		sortByDue(order, due);
+		for (uint8_t k = 0; k < numSensors; k++) {
+			uint8_t i = order[k];
+
+			sleepUntil(due[i]);
+			sensors[i]->startConversion();
+			due[i] = millis() + sensors[i]->conversionTime();
+		}
+
+		// then collect the results as they become ready
+		sortByDue(order, due);
+		for (uint8_t k = 0; k < numSensors; k++) {
+			uint8_t i = order[k];
+
+			sleepUntil(due[i]);
+			sensors[i]->readResult(packet);
+		}
+	}
+
+	// rough time in ms that measure() takes
+	uint16_t measureTime(void) {
+		uint16_t slowest = 0, busy = 0;
+
+		for (uint8_t i = 0; i < numSensors; i++) {
+			uint16_t t = sensors[i]->powerUpTime() + sensors[i]->conversionTime();
+			if (t > slowest) slowest = t;
+			busy += sensors[i]->busTime();
+		}
+
+		return slowest + busy;
+	}
+
+	inline uint8_t getNumSensors(void) {
+		return numSensors;
+	}
+
+	inline Sensor* getSensor(uint8_t i) {
+		return sensors[i];
+	}
+
+	// the SENSOR_xxx type of a sensor, so it can be cast to its SensorDriver class
+	inline uint8_t getType(uint8_t i) {
+		return types[i];
+	}
+
+private:
+	void add(Sensor* sensor, uint8_t type) {
+		if (numSensors < MAX_SENSORS) {
+			sensors[numSensors] = sensor;
+			types[numSensors] = type;
+			numSensors++;
+		}
+	}
+
+	// sort the sensor indexes into order by due time. When sensors are due at the
+	// same time, the one with the longest conversion goes first so it doesn't hold
+	// up the end of the measurement.
+	void sortByDue(uint8_t* order, const uint32_t* due) {
+		for (uint8_t k = 0; k < numSensors; k++) {
+			uint8_t i = k;
+			uint8_t j = k;
+
+			// insertion sort - there are only a handful of sensors
+			while (j > 0 && goesBefore(i, order[j-1], due)) {
+				order[j] = order[j-1];
+				j--;
+			}
+			order[j] = i;
+		}
+	}
+
+	bool goesBefore(uint8_t a, uint8_t b, const uint32_t* due) {
+		int32_t diff = due[a] - due[b];
+
+		if (diff != 0) return diff < 0;
+		return sensors[a]->conversionTime() > sensors[b]->conversionTime();
+	}
+};
+
+#endif
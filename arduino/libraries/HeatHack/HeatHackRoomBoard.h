@@ -0,0 +1,304 @@
+#ifndef HEATHACK_ROOMBOARD_H
+#define HEATHACK_ROOMBOARD_H
+
+#include <Arduino.h>
+#include <avr/sleep.h>
+#include <util/atomic.h>
+
+/*
+ * Drivers for the sensors on the JeeLabs room board.
+ *
+ * These includes won't get picked up properly due to the way the Arduino IDE
+ * builds the include directory list for the compiler. Instead, these includes
+ * need to be put in the main program file before the #include <HeatHackRoomBoard.h> line.
+*/
+#include <JeeLib.h>
+#include <PinChange.h>
+#include "HeatHack.h"
+#include "HeatHackSensors.h"
+
+#ifndef PIR_HOLD_TIME
+	#define PIR_HOLD_TIME    1   // hold PIR value this many seconds after change
+#endif
+#ifndef PIR_PULLUP
+	#define PIR_PULLUP       1   // set to one to pull-up the PIR input pin
+#endif
+#ifndef PIR_INVERTED
+	#define PIR_INVERTED     1   // 0 or 1, to match PIR reporting high or low
+#endif
+#ifndef PIR_STARTUP_SECS
+	#define PIR_STARTUP_SECS 120 // wait this many secs before enabling interrupt to
+	                             // avoid spurious triggers while device is stabilising
+#endif
+
+// extra bits of resolution from oversampling the LDR. Each extra bit takes 4 times
+// as many samples, at about 100us each.
+#ifndef LDR_EXTRA_BITS
+	#define LDR_EXTRA_BITS 2
+#endif
+
+// time in microseconds for the AIO pull-up to charge the pin before sampling the LDR
+#ifndef LDR_SETTLE_US
+	#define LDR_SETTLE_US 100
+#endif
+
+// time in ms before first checking if the HYT131 has finished a measurement.
+// The datasheet gives 100ms as the maximum, but it's usually quicker.
+#ifndef HYT131_CONVERSION_MS
+	#define HYT131_CONVERSION_MS 48
+#endif
+
+// give up on the measurement if it hasn't finished this long after starting it
+#define HYT131_TIMEOUT_MS 150
+
+
+// the ADC interrupt only has to wake the processor from ADC noise reduction sleep
+EMPTY_INTERRUPT(ADC_vect);
+
+/**********************************************************************************
+ * Read an analog input with the processor asleep in ADC noise reduction mode, which
+ * stops the CPU's own noise getting into the readings.
+ *
+ * 4^extraBits samples are summed and the total decimated to give a result with
+ * 10 + extraBits bits, averaging out the rest of the noise. The first sample after
+ * selecting the channel is thrown away while the ADC's input settles.
+ */
+static uint16_t sampleAnalog(uint8_t channel, uint8_t extraBits) {
+	// the ADC clock is divided down from the processor's
+	FullClock fullClock;
+
+	uint8_t oldADCSRA = ADCSRA;
+	uint16_t numSamples = 1 << (2 * extraBits);
+	uint32_t sum = 0;
+
+#if defined(__AVR_ATtiny84__)
+	// Vcc reference
+	ADMUX = channel & 0x3F;
+#else
+	// AVcc reference
+	ADMUX = _BV(REFS0) | (channel & 0x07);
+#endif
+
+	// enable with the interrupt on, clock/128
+	ADCSRA = _BV(ADEN) | _BV(ADIE) | _BV(ADPS2) | _BV(ADPS1) | _BV(ADPS0);
+
+	set_sleep_mode(SLEEP_MODE_ADC);
+
+	for (int16_t i = -1; i < (int16_t) numSamples; i++) {
+		// going to sleep starts a conversion. Other interrupts (e.g. the millis()
+		// timer) may wake us before it's finished, so go back to sleep until it has.
+		sleep_enable();
+		do {
+			sleep_cpu();
+		} while (ADCSRA & _BV(ADSC));
+		sleep_disable();
+
+		if (i >= 0) sum += ADC;
+	}
+
+	ADCSRA = oldADCSRA;
+
+	return sum >> extraBits;
+}
+
+
+/**********************************************************************************
+ * Light dependent resistor between the A pin and ground, as on the room board.
+ * Reports light level from 0 (darkest) to 255 (brightest).
+ *
+ * The pull-up forms a potential divider with the LDR, so it's only turned on
+ * while the oversampled reading is taken (see sampleAnalog()). The extra bits
+ * mean the 8 bit result is steady rather than flickering between adjacent values.
+ */
+class LDR : public SensorBase<LDR> {
+
+public:
+	LDR(byte portNum)
+		: SensorBase<LDR>(portNum) {
+	}
+
+	void init(void) {
+	}
+
+	uint16_t busTime(void) {
+		return 1 + ((1 << (2 * LDR_EXTRA_BITS)) + 1) / 10;
+	}
+
+	void readResult(HeatHackData& packet) {
+		uint16_t level;
+
+		// the settle time's counted in cycles, and the pull-up's only on for it and
+		// the sampling
+		{
+			FullClock fullClock;
+			digiWrite2(1);  // enable AIO pull-up
+			delayMicroseconds(LDR_SETTLE_US);
+			level = sampleAnalog(anaPin(), LDR_EXTRA_BITS);
+			digiWrite2(0);  // disable pull-up to reduce current draw
+		}
+
+		// low reading means bright light
+		byte light = ~ level >> (2 + LDR_EXTRA_BITS);
+
+		HHReading reading;
+		reading.setPort(portNum);
+		reading.setSensor(1);
+		reading.sensorType = HHSensorType::LIGHT;
+		reading.encodedReading = light;
+		packet.addReading(reading);
+	}
+};
+
+
+/**********************************************************************************
+ * Passive infrared motion sensor on the D pin, as on the room board.
+ * Reports the number of times motion was detected since the last reading.
+ *
+ * Motion is counted from a pin-change interrupt registered with PinChange, so
+ * the sketch must include <PinChange.h>. Only one PIR is supported per node.
+ */
+class PIR : public SensorBase<PIR> {
+	volatile byte value;
+	volatile uint16_t count;
+	volatile uint32_t lastOn;
+	bool started;
+
+	// the interrupt handler uses this to find the sensor
+	static PIR* instance;
+
+public:
+	PIR(byte portNum)
+		: SensorBase<PIR>(portNum), value(0), count(0), lastOn(0), started(false) {
+	}
+
+	void init(void) {
+		instance = this;
+		digiWrite(PIR_PULLUP);
+	}
+
+	void readResult(HeatHackData& packet) {
+		// only start counting once the sensor has settled
+		if (!started && millis() > (1000L * PIR_STARTUP_SECS)) {
+			started = true;
+			enableInterrupt();
+		}
+
+		HHReading reading;
+		reading.setPort(portNum);
+		reading.setSensor(1);
+		reading.sensorType = HHSensorType::MOTION;
+		reading.encodedReading = triggerCount();
+		packet.addReading(reading);
+	}
+
+	// this code is called from the pin-change interrupt handler
+	void poll(void) {
+		// see http://talk.jeelabs.net/topic/811#post-4734 for PIR_INVERTED
+		byte pin = digiRead() ^ PIR_INVERTED;
+		// if the pin just went on, then set the changed flag to report it
+		if (pin) {
+			if (!state()) count++;
+			lastOn = millis();
+		}
+		value = pin;
+	}
+
+	// state is true if curr value is still on or if it was on recently
+	byte state(void) const {
+		byte f = value;
+		if (lastOn > 0) {
+			ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+				if (millis() - lastOn < PIR_HOLD_TIME * 1000) {
+					f = 1;
+				}
+			}
+		}
+
+		return f;
+	}
+
+	// return number of motion triggers since last time the method was called
+	uint16_t triggerCount(void) {
+		uint16_t result;
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+			result = count;
+			count = 0;
+		}
+		return result;
+	}
+
+	void enableInterrupt(void) {
+		TRACE_EVENT(TRACE_ROOMBOARD, 1);
+
+		PinChange::attach(digiPin(), pinChanged);
+	}
+
+	void disableInterrupt(void) {
+		TRACE_EVENT(TRACE_ROOMBOARD, 0);
+
+		PinChange::detach(digiPin());
+	}
+
+	// the PIR signal comes in via a pin-change interrupt, shared with the DHT
+	static void pinChanged(uint8_t pins, uint8_t changed) {
+		if (instance) instance->poll();
+	}
+};
+
+PIR* PIR::instance = 0;
+
+
+/**********************************************************************************
+ * HYT131 temperature/humidity sensor on the I2C bus, as on the room board.
+ *
+ * The measurement is requested in startConversion() so the node can sleep through
+ * it along with the other sensors. readResult() then checks the stale bit and, if
+ * the measurement still hasn't finished, sleeps in 16ms steps until it has.
+ */
+class HYT131Sensor : public SensorBase<HYT131Sensor> {
+	PortI2C i2c;
+	HYT131 hyt;
+	uint32_t requestTime;
+
+public:
+	HYT131Sensor(byte portNum)
+		: SensorBase<HYT131Sensor>(portNum), i2c(portNum), hyt(i2c), requestTime(0) {
+	}
+
+	void init(void) {
+	}
+
+	uint16_t conversionTime(void) {
+		return HYT131_CONVERSION_MS;
+	}
+
+	void startConversion(void) {
+		hyt.request();
+		requestTime = millis();
+	}
+
+	void readResult(HeatHackData& packet) {
+		int temp, humi;
+
+		while (!hyt.fetch(temp, humi)) {
+			// no reading this time if the sensor's stopped responding
+			if (millis() - requestTime > HYT131_TIMEOUT_MS) return;
+
+			Sleepy::loseSomeTime(16);
+		}
+
+		HHReading reading;
+		reading.setPort(portNum);
+		reading.setSensor(1);
+		reading.sensorType = HHSensorType::TEMPERATURE;
+		reading.encodedReading = temp;
+		packet.addReading(reading);
+
+		reading.setSensor(2);
+		reading.sensorType = HHSensorType::HUMIDITY;
+		reading.encodedReading = humi;
+		packet.addReading(reading);
+	}
+};
+
+#endif
@@ -0,0 +1,187 @@
+#ifndef HEATHACK_SECURE_H
+#define HEATHACK_SECURE_H
+
+#include <Arduino.h>
+#include <avr/eeprom.h>
+#include "HeatHack.h"
+
+/*
+ * Secured packets, so that readings can't be forged or replayed by someone else
+ * with a radio in a public building.
+ *
+ * A node's HeatHackData goes out with a 4 byte counter and a 4 byte tag after it.
+ * The tag is a CBC-MAC over the node id, counter and data, and the readings are
+ * encrypted in counter mode, both with the Speck64/128 block cipher much as CCM
+ * does with AES. Speck's rounds are just adds, xors and rotates of 32 bit words,
+ * and the rotates are by 8 and 3 bits, which suits the AVR. The data's first byte,
+ * the number of readings and the sequence number, is authenticated but left in
+ * clear so repeaters can still pass the data on without the key.
+ *
+ * The counter goes up with every packet a node sends and isn't reused after a
+ * reset, as its top 16 bits count the node's boots in EEPROM. The receiver keeps
+ * the highest counter it's accepted from each node and which of the SECURE_WINDOW
+ * below it it's seen, and drops anything else as a replay.
+ *
+ * Every node and receiver in the group has the same 16 byte key. It's kept in
+ * EEPROM where RF12 encryption keeps its key, and set with the config console's k
+ * command. Test packets from findMinTransmitPower aren't secured, and the receiver
+ * acks them without reporting them.
+ *
+ * HeatHackSecureBench times it all and prints the bytes and cycles it adds.
+ *
+ * Security is off unless the sketch defines SECURE as true before including the
+ * HeatHack headers.
+ */
+#ifndef SECURE
+	#define SECURE false
+#endif
+
+// bytes added to a secured packet, the counter then the tag
+#define SECURE_TRAILER 8
+
+#if SECURE
+
+#if defined(__AVR_ATtiny84__)
+	#error The JeeNode Micro has no config console to set the key with
+#endif
+
+// counters below the highest that the receiver remembers, for copies of a packet
+// that come through a repeater after a later packet
+#define SECURE_WINDOW 8
+
+#define SECURE_ROUNDS 27
+#define EEPROM_SECURE_KEY RF12_EEPROM_EKEY
+
+static uint32_t secureRoundKeys[SECURE_ROUNDS];
+static bool secureKeySet = false;
+
+// the node's next counter, see secureNextCounter
+static uint32_t secureCounter = 0;
+
+// expand the 16 byte key into the round keys
+static void secureSetKey(const uint8_t* key) {
+	uint32_t k;
+	uint32_t l[3];
+	memcpy(&k, key, sizeof(k));
+	memcpy(l, key + sizeof(k), sizeof(l));
+
+	for (uint8_t i = 0; i < SECURE_ROUNDS; i++) {
+		secureRoundKeys[i] = k;
+		uint32_t next = (((l[i % 3] >> 8) | (l[i % 3] << 24)) + k) ^ i;
+		k = ((k << 3) | (k >> 29)) ^ next;
+		l[i % 3] = next;
+	}
+}
+
+// encrypt one 8 byte block in place, y in the first word and x in the second
+static void secureEncrypt(uint32_t* block) {
+	uint32_t x = block[1];
+	uint32_t y = block[0];
+
+	for (uint8_t i = 0; i < SECURE_ROUNDS; i++) {
+		x = (((x >> 8) | (x << 24)) + y) ^ secureRoundKeys[i];
+		y = ((y << 3) | (y >> 29)) ^ x;
+	}
+
+	block[0] = y;
+	block[1] = x;
+}
+
+// load the key from EEPROM. Returns false if it's never been set.
+static bool secureInit(void) {
+	uint8_t key[16];
+	eeprom_read_block(key, EEPROM_SECURE_KEY, sizeof(key));
+
+	secureKeySet = false;
+	for (uint8_t i = 0; i < sizeof(key); i++) {
+		if (key[i] != 0xFF) secureKeySet = true;
+	}
+
+	secureSetKey(key);
+	return secureKeySet;
+}
+
+// a block that's unique to a packet and to its use in the packet, as the same key
+// does both jobs. kind is 'M' for the MAC and 'C' for counter mode.
+static void secureNonce(uint32_t* block, uint8_t kind, uint8_t n, uint16_t node, uint32_t counter) {
+	block[0] = kind | ((uint16_t) n << 8) | ((uint32_t) node << 16);
+	block[1] = counter;
+}
+
+// CBC-MAC of the data, starting from a block with its length. Returns half of it.
+static uint32_t secureMac(uint16_t node, uint32_t counter, const uint8_t* data, uint8_t len) {
+	uint32_t block[2];
+	uint8_t* bytes = (uint8_t*) block;
+
+	secureNonce(block, 'M', len, node, counter);
+	secureEncrypt(block);
+
+	for (uint8_t pos = 0; pos < len; pos += 8) {
+		for (uint8_t i = 0; i < 8 && pos + i < len; i++) bytes[i] ^= data[pos + i];
+		secureEncrypt(block);
+	}
+
+	return block[0];
+}
+
+// xor the data after its first byte with the counter mode key stream, which both
+// encrypts and decrypts it. Returns the key stream block before the data's, which
+// the tag is xored with.
+static uint32_t secureCrypt(uint16_t node, uint32_t counter, uint8_t* data, uint8_t len) {
+	uint32_t block[2];
+	uint8_t* bytes = (uint8_t*) block;
+
+	secureNonce(block, 'C', 0, node, counter);
+	secureEncrypt(block);
+	uint32_t tagMask = block[0];
+
+	for (uint8_t pos = 1, n = 1; pos < len; pos += 8, n++) {
+		secureNonce(block, 'C', n, node, counter);
+		secureEncrypt(block);
+		for (uint8_t i = 0; i < 8 && pos + i < len; i++) data[pos + i] ^= bytes[i];
+	}
+
+	return tagMask;
+}
+
+// secure len bytes of data in place and put the counter and tag after them, so
+// there must be room for SECURE_TRAILER more. Returns the new length.
+static uint8_t secureSeal(uint16_t node, uint32_t counter, uint8_t* data, uint8_t len) {
+	uint32_t tag = secureMac(node, counter, data, len);
+	tag ^= secureCrypt(node, counter, data, len);
+
+	memcpy(data + len, &counter, sizeof(counter));
+	memcpy(data + len + sizeof(counter), &tag, sizeof(tag));
+	return len + SECURE_TRAILER;
+}
+
+// check a secured packet and decrypt it in place. Returns the length of the data,
+// or 0 if it isn't genuine, and sets counter to the packet's counter.
+static uint8_t secureOpen(uint16_t node, uint8_t* data, uint8_t len, uint32_t& counter) {
+	if (!secureKeySet || len <= SECURE_TRAILER) return 0;
+
+	len -= SECURE_TRAILER;
+	uint32_t tag;
+	memcpy(&counter, data + len, sizeof(counter));
+	memcpy(&tag, data + len + sizeof(counter), sizeof(tag));
+
+	tag ^= secureCrypt(node, counter, data, len);
+	return tag == secureMac(node, counter, data, len) ? len : 0;
+}
+
+// the counter for the node's next packet. The top 16 bits are bumped in EEPROM at
+// the first packet after a reset, and when the bottom 16 bits wrap round.
+static uint32_t secureNextCounter(void) {
+	if ((uint16_t) secureCounter == 0) {
+		uint16_t boots = eeprom_read_word((uint16_t*) EEPROM_SECURE_BOOTS) + 1;
+		if (boots == 0) boots = 1;  // erased EEPROM, and counter 0 is never accepted
+		eeprom_update_word((uint16_t*) EEPROM_SECURE_BOOTS, boots);
+		secureCounter = (uint32_t) boots << 16;
+	}
+
+	return secureCounter++;
+}
+
+#endif
+
+#endif
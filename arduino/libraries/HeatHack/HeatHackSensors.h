@@ -3,6 +3,7 @@
 
 #include <Arduino.h>
 #include <avr/sleep.h>
+#include <avr/eeprom.h>
 
 /*
  * These includes won't get picked up properly due to the way the Arduino IDE
@@ -12,6 +13,16 @@
 #include <JeeLib.h>
 #include <OneWire.h>
 #include "HeatHack.h"
+#include "HeatHackClock.h"
+#include "HeatHackTrace.h"
+
+#ifndef DHT_USE_INTERRUPTS
+	#define DHT_USE_INTERRUPTS true
+#endif
+
+#if DHT_USE_INTERRUPTS
+	#include <PinChange.h>
+#endif
 
 
 
@@ -21,13 +32,13 @@
 #define MIN_I2C_ADDR 7
 #define MAX_I2C_ADDR 120
 #define I2C_HYT131 0x28
+#define I2C_BMP085 0x77
 #define I2C_LCD 0x24
 #define I2C_RTC 0x68
 
 
-#ifndef DHT_USE_INTERRUPTS
-	#define DHT_USE_INTERRUPTS true
-#endif
+// max time to wait for the sensor to send all its data
+#define DHT_READ_TIMEOUT_MS 10
 
 // Counting pulse lengths depends on processor clock speed.
 // Assumption here is that the tiny84 (JNMicro) is at 8MHz, otherwise 16MHz.
@@ -45,6 +56,9 @@
 #define DHT11_ACTIVATION_MS 18
 #define DHT22_ACTIVATION_MS 1
 
+// sensor needs 1 sec to stabilise after power is applied
+#define DHT_POWERUP_TIME_MS 1000
+
 
 // Model IDs
 #define DS18S20MODEL 0x10  // also DS1820
@@ -112,15 +126,63 @@
 #define DS18B_READ_TIME_MS 750
 
 
-class Sensor : public Port {
+// wait in low power mode until millis() reaches time. Sleepy is woken early by
+// other interrupts (e.g. the PIR) so keep going until the time's really up.
+static void sleepUntil(uint32_t time) {
+	int32_t remaining;
+
+	while ((remaining = time - millis()) > 0) {
+		if (remaining >= 16) Sleepy::loseSomeTime(remaining);
+		else delay(remaining);
+	}
+}
+
+/**********************************************************************************
+ * Base class for the sensor drivers, where T is the driver class itself.
+ *
+ * A reading is taken in three steps so that several sensors can be read together
+ * with their waits overlapped (see HeatHackRegistry.h and HeatHackNode.h):
+ *  powerOn()         turn on the sensor's power. Must not wait.
+ *  startConversion() called powerUpTime() ms after powerOn(). Must not wait.
+ *  readResult()      called conversionTime() ms after startConversion(). Adds the
+ *                    readings to the packet and turns the sensor's power off again.
+ *
+ * busTime() is roughly how long the processor is kept awake by startConversion()
+ * and readResult(), i.e. the time that can't be overlapped with other sensors.
+ *
+ * A driver only defines the steps and times it needs. There are no virtual
+ * functions, so a driver costs no vtable and its calls can be inlined. Use
+ * SensorDriver in HeatHackRegistry.h when the sensors are only known at run time.
+ */
+template<class T>
+class SensorBase : public Port {
 
 public:
-	Sensor(byte portNum)
+	SensorBase(byte portNum)
 		: Port(portNum) {
 	}
-	
-	virtual void init(void) = 0;
-	virtual void reading(HeatHackData& packet) = 0;
+
+	inline byte getPort(void) {
+		return portNum;
+	}
+
+	void powerOn(void) {}
+	void startConversion(void) {}
+
+	uint16_t powerUpTime(void) { return 0; }
+	uint16_t conversionTime(void) { return 0; }
+	uint16_t busTime(void) { return 1; }
+
+	// take a reading from this sensor on its own
+	void reading(HeatHackData& packet) {
+		T& self = static_cast<T&>(*this);
+
+		self.powerOn();
+		sleepUntil(millis() + self.powerUpTime());
+		self.startConversion();
+		sleepUntil(millis() + self.conversionTime());
+		self.readResult(packet);
+	}
 };
 
 extern void serialFlush (void);
@@ -135,9 +197,13 @@ extern void serialFlush (void);
  * and idDHT11 for the interrupt-based read.
  *
  * Sensor's data line should be connected to the D  pin. Reading the data can be interrupt-driven
- * or polled. Interrupt is preferred as it will be lower powered, but could cause problems if other
- * interrupt-driven devices are also in use (eg PIR motion sensor). Also, the interrupt version
- * of the code is slightly larger.
+ * or polled. Interrupt is preferred as it will be lower powered and, unlike polling, doesn't
+ * disable interrupts for the whole read so the radio and other sensors keep working. The
+ * interrupt version of the code is slightly larger.
+ *
+ * The pin-change interrupt is shared through the PinChange library, so other interrupt-driven
+ * sensors (eg PIR motion sensor) can use the same bank. The sketch must include <PinChange.h>
+ * and register any handlers of its own with PinChange::attach() rather than defining ISRs.
  * 
  * If sensor's power is connected to A instead of +, it will only be turned on
  * when taking a reading to save power.
@@ -154,7 +220,7 @@ extern void serialFlush (void);
  * Sleepy is used for delays, therefore ISR(WDT_vect) { Sleepy::watchdogEvent(); }
  * must be included in the main sketch.
  */
-class DHT : public Sensor {
+class DHT : public SensorBase<DHT> {
   byte type;
   uint8_t dataPin;
 
@@ -169,7 +235,7 @@ class DHT : public Sensor {
   volatile static uint32_t pulseStartTime;
   volatile static bool acquiring;
   volatile static bool acquiredSuccessfully;
-  volatile static uint8_t intDataPin;
+  static uint8_t pinMask; // data pin's bit in its port
 #else
   static uint8_t data[5]; // holds the raw data
   static uint8_t currentBit;
@@ -181,11 +247,11 @@ public:
    * sensorType: DHT11_TYPE or DHT22_TYPE
    */
   DHT (byte portNum, byte type)
-  : Sensor(portNum), type(type), dataPin(0) {
+  : SensorBase<DHT>(portNum), type(type), dataPin(0) {
   }
 
   DHT (byte portNum)
-  : Sensor(portNum), type(SENSOR_NONE), dataPin(0) {
+  : SensorBase<DHT>(portNum), type(SENSOR_NONE), dataPin(0) {
   }
 
   // test for the presence of a DHT sensor on the given port
@@ -207,36 +273,31 @@ public:
 	return type;
   }
   
-  void reading (HeatHackData& packet) {
+  uint16_t powerUpTime(void) {
+    return type == SENSOR_NONE ? 0 : DHT_POWERUP_TIME_MS;
+  }
+
+  uint16_t busTime(void) {
+    // activation signal and 5ms of data
+    return type == SENSOR_DHT11 ? 25 : 6;
+  }
+
+  void powerOn(void) {
+    if (type != SENSOR_NONE) enablePower();
+  }
 
-    // nasty hack, but without it the DHT only works if DEBUG
-    // is enabled or the LCD is plugged in!
-    delay(10);
+  void readResult (HeatHackData& packet) {
+    // the pulse lengths are timed by counting cycles
+    FullClock fullClock;
 
+    // the data line's been idle high since powerOn(), which is all the sensor needs
+    // before the activation signal
     if (type == SENSOR_NONE) return;
 
-    enablePower();
     bool success = readRawData();
 
-#if DEBUG
-    if (!success) {
-      Serial.println(F("DHT readRawData failed"));
-      serialFlush();
-    }
-    else {
-        Serial.print(F("DHT data: "));
-        Serial.print(data[0], DEC);
-        Serial.print(F(" "));
-        Serial.print(data[1], DEC);
-        Serial.print(F(" "));
-        Serial.print(data[2], DEC);
-        Serial.print(F(" "));
-        Serial.print(data[3], DEC);
-        Serial.print(F(" "));
-        Serial.println(data[4], DEC);
-        serialFlush();
-    }
-#endif
+    // integer parts of humidity and temperature, or all bits set if the read failed
+    TRACE_EVENT(TRACE_SENSORS, success ? ((uint16_t) data[0] << 8) | data[2] : 0xFFFF);
 
     disablePower();
 
@@ -262,10 +323,10 @@ public:
   }
 
 #if DHT_USE_INTERRUPTS  
-  // the interrupt handler
-  static void isrCallback() {
+  // the interrupt handler, called by PinChange when the data pin changes
+  static void pinChanged(uint8_t pins, uint8_t changed) {
     // only interested in the falling edge
-    if (digitalRead(intDataPin) != LOW) return;
+    if (!acquiring || (pins & pinMask)) return;
 
     uint32_t pulseEndTime = micros();
     unsigned int delta = (pulseEndTime - pulseStartTime);
@@ -309,6 +370,7 @@ protected:
 
     if (type == SENSOR_NONE) {
       enablePower();
+      Sleepy::loseSomeTime(DHT_POWERUP_TIME_MS);
       type = testPort(portNum, useIPin);
       disablePower();
     }
@@ -325,9 +387,6 @@ protected:
     // let pull-up resistor pull data bus high
     pinMode(dataPin, INPUT);
     digitalWrite(dataPin, LOW);
-
-    // sensor needs 1 sec to stabilise after power is applied
-    Sleepy::loseSomeTime(1000);
   }
   
   inline void disablePower(void) {
@@ -456,36 +515,30 @@ protected:
     set_sleep_mode(SLEEP_MODE_IDLE);
     sleep_enable();
 
-    acquiring = true;
     acquiredSuccessfully = false;
     currentBit = 0;
-    intDataPin = dataPin;
+    pinMask = digitalPinToBitMask(dataPin);
     pulseStartTime = micros();
+    acquiring = true;
 
     // enable interrupt
-    #if defined(__AVR_ATtiny84__)
-      bitSet(PCMSK0, portNum * 2 - 2); // port1 = PCINT0, port2 = PCINT2
-      bitSet(GIMSK, PCIE0);
-    #else
-      bitSet(PCMSK2, dataPin);
-      bitSet(PCICR, PCIE2);
-    #endif
+    if (!PinChange::attach(dataPin, pinChanged)) {
+      acquiring = false;
+    }
+
+    uint32_t start = millis();
 
     do {
-      // wait for interrupt
+      // wait for interrupt. The timer interrupt will wake us at least every
+      // millisecond in case the sensor stops responding.
       sleep_cpu();
-    } while (acquiring);
+    } while (acquiring && millis() - start < DHT_READ_TIMEOUT_MS);
 
+    acquiring = false;
     sleep_disable();
 
     // disable interrupt
-    #if defined(__AVR_ATtiny84__)
-      bitClear(GIMSK, PCIE0);
-      bitClear(PCMSK0, portNum * 2 - 2); // port1 = PCINT0, port2 = PCINT2
-    #else
-      bitClear(PCICR, PCIE2);
-      bitClear(PCMSK2, dataPin);
-    #endif
+    PinChange::detach(dataPin);
 
     return acquiredSuccessfully;
   }
@@ -574,22 +627,12 @@ volatile uint8_t DHT::currentBit;
 volatile uint32_t DHT::pulseStartTime;
 volatile bool DHT::acquiring;
 volatile bool DHT::acquiredSuccessfully;
-volatile uint8_t DHT::intDataPin;
+uint8_t DHT::pinMask;
 #else
 uint8_t DHT::data[5]; // holds the raw data
 uint8_t DHT::currentBit;
 #endif
 
-#if DHT_USE_INTERRUPTS  
-	#if defined(__AVR_ATtiny84__)
-		#define DHT_INT PCINT0_vect
-	#else
-		#define DHT_INT PCINT2_vect
-	#endif
-
-	ISR(DHT_INT) { DHT::isrCallback(); }
-#endif
-
 
 typedef uint8_t DeviceAddress[8];
 typedef uint8_t ScratchPad[9];
@@ -597,69 +640,379 @@ typedef uint8_t ScratchPad[9];
 /**********************************************************************************
  * Interface for the Dallas DS18B20 sensors.
  * Note there is no support for the DS18Sxx and DS18xx sensors to simplfy the code.
+ *
+ * The ROM addresses of the devices found on the bus are kept in a table of
+ * DS18B_MAX_DEVICES slots. The slot number is used as the sensor number in the
+ * readings, so a sensor keeps the same number for as long as it stays on the bus.
+ *
+ * The table is cached in EEPROM (protected by a CRC) so that at boot each known
+ * device only needs a targeted read to check it's still there. A full search of
+ * the bus is only done if the cache is invalid or a cached device doesn't respond.
+ *
+ * Every DS18B_RESCAN_CYCLES readings a background rescan is started to pick up
+ * sensors that have been added since boot. The rescan finds one device per reading
+ * cycle so it never adds more than a single search to any one cycle. A new sensor
+ * takes the first empty slot, or failing that the slot of a sensor that has stopped
+ * responding.
+ *
+ * In alarm mode (DS18B_ALARM_MODE) each sensor's high and low alarm registers are
+ * set DS18B_ALARM_WINDOW degrees either side of a reading. After each conversion a
+ * conditional (alarm) search finds just the sensors whose temperature has moved out
+ * of that window and only those are read and reported. All sensors are still read
+ * every DS18B_ALARM_REFRESH_CYCLES readings so that the logger knows they're alive.
+ * The window is only moved, centred on the new reading, when a reading's outside
+ * it, so a temperature hovering at a whole degree doesn't move it back and forth.
+ *
+ * If the bus is powered from the A pin the sensors lose their registers when it's
+ * switched off, so anything written to them is copied to their EEPROM as well. That
+ * wears it out after about 50,000 writes, which the window keeps to one each time
+ * the temperature moves by DS18B_ALARM_WINDOW degrees.
  */
-class DS18B : public Sensor {
+
+// number of sensors supported on a single port.
+// The reading header only has 2 bits for the sensor number so this can't be more than 4.
+#ifndef DS18B_MAX_DEVICES
+	#define DS18B_MAX_DEVICES 4
+#endif
+
+#if DS18B_MAX_DEVICES > 4
+	#error "DS18B_MAX_DEVICES can't be more than 4"
+#endif
+
+// number of readings between background rescans of the bus for new sensors.
+// Set to 0 to disable rescanning.
+#ifndef DS18B_RESCAN_CYCLES
+	#define DS18B_RESCAN_CYCLES 30
+#endif
+
+// cache the device table in EEPROM. Disabled on the Micro to save flash.
+#ifndef DS18B_EEPROM_CACHE
+	#if defined(__AVR_ATtiny84__)
+		#define DS18B_EEPROM_CACHE false
+	#else
+		#define DS18B_EEPROM_CACHE true
+	#endif
+#endif
+
+// only read sensors whose temperature has changed, using the alarm registers
+#ifndef DS18B_ALARM_MODE
+	#define DS18B_ALARM_MODE false
+#endif
+
+// whole degrees either side of the reading the window was centred on before a
+// sensor alarms. The sensor compares whole degrees rounded down, so with 1 a reading
+// that went from 20.0 to 19.9 would alarm.
+#ifndef DS18B_ALARM_WINDOW
+	#define DS18B_ALARM_WINDOW 2
+#endif
+
+// number of readings between reading all sensors regardless of alarms
+#ifndef DS18B_ALARM_REFRESH_CYCLES
+	#define DS18B_ALARM_REFRESH_CYCLES 10
+#endif
+
+// size of the cached table in EEPROM: number of slots, the addresses then a CRC
+#define DS18B_TABLE_SIZE (1 + DS18B_MAX_DEVICES * sizeof(DeviceAddress) + 1)
+
+class DS18B : public SensorBase<DS18B> {
 
   uint8_t numDevices;
-  DeviceAddress deviceAddress[3];
+  uint8_t missing;  // bit set for each slot whose device didn't respond to its last read
+  bool switchedPower;  // the bus is powered from the A pin, so it's off between readings
+  DeviceAddress deviceAddress[DS18B_MAX_DEVICES];  // empty slots have a zero family code
   OneWire oneWire;
+
+#if DS18B_RESCAN_CYCLES
+  uint8_t rescanCountdown;
+  bool rescanning;
+#endif
+
+#if DS18B_ALARM_MODE
+  // alarm searches use their own search state so they don't upset a background rescan
+  OneWire alarmBus;
+  uint8_t refreshCountdown;
+#endif
   
 public:
   
   DS18B (byte portNum)
-	: Sensor(portNum), numDevices(0) {
+	: SensorBase<DS18B>(portNum), numDevices(0), missing(0), switchedPower(true) {
 
 	// Setup a oneWire instance to communicate with any OneWire devices (not just Maxim/Dallas temperature ICs)
 	oneWire.init(digiPin());
+
+	memset(deviceAddress, 0, sizeof(deviceAddress));
+
+#if DS18B_RESCAN_CYCLES
+	rescanCountdown = DS18B_RESCAN_CYCLES;
+	rescanning = false;
+#endif
+
+#if DS18B_ALARM_MODE
+	alarmBus.init(digiPin());
+	refreshCountdown = 0;
+#endif
   }
   
   // initialise the bus and determine the available sensors
-  // note this can only be called once as search isn't reset
   void init(void) {
+	// the A pin also powers the data line's pull-up on a bus that it powers, so the
+	// line's low while A is
+	mode2(OUTPUT);
+	disablePower();
+	mode(INPUT);
+	delay(1);
+	switchedPower = !digiRead();
+
 	enablePower();
-  
-	// get addresses of first 3 devices	
-    while (numDevices < 3 && oneWire.search(deviceAddress[numDevices])) {
-		// check address is valid
-        if (oneWire.crc8(deviceAddress[numDevices], 7) == deviceAddress[numDevices][7]) {
-            numDevices++;
-        }
-    }
+	Sleepy::loseSomeTime(DS18B_POWERUP_TIME_MS);
+
+	bool verified = loadTable();
+
+	// check each cached device is still there and set its resolution
+	for (uint8_t i=0; i < DS18B_MAX_DEVICES; i++) {
+		if (deviceAddress[i][0] != 0 && !setResolution(deviceAddress[i], DS18B_RESOLUTION)) {
+			missing |= 1 << i;
+			verified = false;
+		}
+	}
 
-	// set resolution
-	for (uint8_t i=0; i < numDevices; i++) {
-		setResolution(deviceAddress[i], DS18B_RESOLUTION);
+	// only search the whole bus if the cache couldn't be trusted
+	if (!verified || numDevices == 0) {
+		fullSearch();
 	}
-	
+
 	disablePower();
   }
   
-  // take readings for all connected devices
-  void reading (HeatHackData& packet) {
+  uint16_t powerUpTime(void) {
+    return DS18B_POWERUP_TIME_MS;
+  }
+
+  uint16_t conversionTime(void) {
+    // nothing to wait for if there are no sensors, though a rescan may still find one
+    return numDevices ? DS18B_READ_TIME_MS : 0;
+  }
+
+  uint16_t busTime(void) {
+    // about 10ms to address and read each scratchpad
+    return 2 + 10 * numDevices;
+  }
 
+  void powerOn(void) {
     enablePower();
-      requestTemperatures();
+  }
+
+  // sends command for all devices on the bus to perform a temperature conversion
+  void startConversion(void) {
+    FullClock fullClock;
+
+    oneWire.reset();
+    oneWire.skip();
+    oneWire.write(STARTCONVO, true);
+  }
+
+  // take readings for all connected devices
+  void readResult (HeatHackData& packet) {
+    // OneWire's timing is done with delayMicroseconds()
+    FullClock fullClock;
 
     HHReading reading;
     reading.setPort(portNum);
     reading.sensorType = HHSensorType::TEMPERATURE;
 
-    for (uint8_t i=0; i < numDevices; i++) {
+    // bit set for each slot to be read
+    uint8_t toRead = 0xFF;
+
+#if DS18B_ALARM_MODE
+    if (refreshCountdown == 0) {
+      refreshCountdown = DS18B_ALARM_REFRESH_CYCLES;
+    }
+    else {
+      refreshCountdown--;
+      toRead = alarmedDevices();
+    }
+#endif
+
+    for (uint8_t i=0; i < DS18B_MAX_DEVICES; i++) {
+      if (deviceAddress[i][0] == 0 || !(toRead & (1 << i))) continue;
+
+      ScratchPad scratchPad;
       reading.setSensor(i + 1);
-      reading.encodedReading = getTemp(deviceAddress[i]);
+      reading.encodedReading = getTemp(deviceAddress[i], scratchPad);
 
       if (reading.encodedReading != DS18B_INVALID_TEMP) {
         packet.addReading(reading);
+        missing &= ~(1 << i);
+
+#if DS18B_ALARM_MODE
+        setAlarms(deviceAddress[i], scratchPad);
+#endif
+      }
+      else {
+        missing |= 1 << i;
       }
     }
 
+#if DS18B_RESCAN_CYCLES
+    if (rescanning || --rescanCountdown == 0) {
+      rescanStep();
+    }
+#endif
+
     disablePower();
   }
   
+  // number of sensors that responded the last time they were read
   uint8_t getNumDevices(void) {
-	return numDevices;
+	uint8_t count = 0;
+	for (uint8_t i=0; i < DS18B_MAX_DEVICES; i++) {
+		if (deviceAddress[i][0] != 0 && !(missing & (1 << i))) count++;
+	}
+	return count;
   }
   
+protected:
+
+  // search the whole bus, adding any devices not already in the table
+  void fullSearch(void) {
+	DeviceAddress addr;
+
+	oneWire.reset_search();
+	while (oneWire.search(addr)) {
+		addDevice(addr);
+	}
+
+	saveTable();
+  }
+
+#if DS18B_RESCAN_CYCLES
+  // find the next device on the bus. Search state is kept by OneWire between calls
+  // so each call continues from where the last one left off.
+  void rescanStep(void) {
+	DeviceAddress addr;
+
+	if (oneWire.search(addr)) {
+		rescanning = true;
+		if (addDevice(addr)) saveTable();
+	}
+	else {
+		// reached the end of the bus. OneWire resets its search state itself.
+		rescanning = false;
+		rescanCountdown = DS18B_RESCAN_CYCLES;
+	}
+  }
+#endif
+
+  // put a device into the table if it isn't already there.
+  // Returns true if the table was changed.
+  bool addDevice(const uint8_t* addr) {
+	// check address is valid
+	if (oneWire.crc8(addr, 7) != addr[7]) return false;
+
+	uint8_t slot = DS18B_MAX_DEVICES;
+
+	for (uint8_t i=0; i < DS18B_MAX_DEVICES; i++) {
+		if (memcmp(deviceAddress[i], addr, sizeof(DeviceAddress)) == 0) {
+			// already known
+			return false;
+		}
+		if (slot == DS18B_MAX_DEVICES && deviceAddress[i][0] == 0) slot = i;
+	}
+
+	// no empty slots so reuse one belonging to a sensor that's stopped responding
+	for (uint8_t i=0; i < DS18B_MAX_DEVICES && slot == DS18B_MAX_DEVICES; i++) {
+		if (missing & (1 << i)) slot = i;
+	}
+
+	if (slot == DS18B_MAX_DEVICES) return false;
+
+	// a reused slot's already counted
+	if (deviceAddress[slot][0] == 0) numDevices++;
+
+	memcpy(deviceAddress[slot], addr, sizeof(DeviceAddress));
+	missing &= ~(1 << slot);
+
+	setResolution(deviceAddress[slot], DS18B_RESOLUTION);
+	return true;
+  }
+
+#if DS18B_ALARM_MODE
+  // find the sensors whose temperature has moved outside their alarm window
+  // since they were last read. Returns a bit set for each alarming slot.
+  uint8_t alarmedDevices(void) {
+	uint8_t alarmed = 0;
+	DeviceAddress addr;
+
+	alarmBus.reset_search();
+	while (alarmBus.search(addr, false)) {
+		// a newly attached sensor will usually be alarming as its window hasn't been set yet
+		if (addDevice(addr)) saveTable();
+
+		for (uint8_t i=0; i < DS18B_MAX_DEVICES; i++) {
+			if (memcmp(deviceAddress[i], addr, sizeof(DeviceAddress)) == 0) alarmed |= 1 << i;
+		}
+	}
+
+	return alarmed;
+  }
+
+  // centre the sensor's alarm window on the reading just taken from its scratchpad,
+  // if the reading's outside it
+  void setAlarms(const uint8_t* deviceAddress, uint8_t* scratchPad) {
+	// alarms are compared against the whole degrees part of the temperature, and the
+	// sensor alarms at either limit as well as beyond it
+	int8_t whole = (int8_t) ((scratchPad[TEMP_MSB] << 4) | (scratchPad[TEMP_LSB] >> 4));
+	if (whole > (int8_t) scratchPad[LOW_ALARM_TEMP] && whole < (int8_t) scratchPad[HIGH_ALARM_TEMP]) return;
+
+	scratchPad[HIGH_ALARM_TEMP] = whole + DS18B_ALARM_WINDOW;
+	scratchPad[LOW_ALARM_TEMP] = whole - DS18B_ALARM_WINDOW;
+	writeScratchPad(deviceAddress, scratchPad);
+  }
+#endif
+
+  // read the cached device table from EEPROM. Returns false if there is no valid table.
+  bool loadTable(void) {
+#if DS18B_EEPROM_CACHE
+	uint8_t table[DS18B_TABLE_SIZE];
+	eeprom_read_block(table, tableAddress(), DS18B_TABLE_SIZE);
+
+	if (table[0] != DS18B_MAX_DEVICES || oneWire.crc8(table, DS18B_TABLE_SIZE - 1) != table[DS18B_TABLE_SIZE - 1]) {
+		return false;
+	}
+
+	memcpy(deviceAddress, &table[1], sizeof(deviceAddress));
+
+	numDevices = 0;
+	for (uint8_t i=0; i < DS18B_MAX_DEVICES; i++) {
+		if (deviceAddress[i][0] != 0) numDevices++;
+	}
+	return true;
+#else
+	return false;
+#endif
+  }
+
+  // write the device table to EEPROM. Only changed bytes are written.
+  void saveTable(void) {
+#if DS18B_EEPROM_CACHE
+	uint8_t table[DS18B_TABLE_SIZE];
+
+	table[0] = DS18B_MAX_DEVICES;
+	memcpy(&table[1], deviceAddress, sizeof(deviceAddress));
+	table[DS18B_TABLE_SIZE - 1] = oneWire.crc8(table, DS18B_TABLE_SIZE - 1);
+
+	for (uint8_t i=0; i < DS18B_TABLE_SIZE; i++) {
+		eeprom_update_byte(tableAddress() + i, table[i]);
+	}
+#endif
+  }
+
+  // each port has its own table
+  inline uint8_t* tableAddress(void) {
+	return EEPROM_DS18B_TABLE + (portNum - 1) * DS18B_TABLE_SIZE;
+  }
+
 protected:
 
   void enablePower(void) {
@@ -669,8 +1022,6 @@ protected:
 	
 	// set data pin as input
 	mode(INPUT);
-	
-    Sleepy::loseSomeTime(DS18B_POWERUP_TIME_MS);
   }
 
   void disablePower(void) {
@@ -690,27 +1041,20 @@ protected:
 	// note isConnected() also reads the scratchpad
 	if (isConnected(deviceAddress, scratchPad))
 	{
-		scratchPad[CONFIGURATION] = newResolution;
-		writeScratchPad(deviceAddress, scratchPad);
+		// avoid wearing the device's EEPROM if it's already set
+		if (scratchPad[CONFIGURATION] != newResolution) {
+			scratchPad[CONFIGURATION] = newResolution;
+			writeScratchPad(deviceAddress, scratchPad);
+		}
 		return true;  // new value set
 	}
 	return false;
   }
 
-  // sends command for all devices on the bus to perform a temperature conversion
-  inline void requestTemperatures() {
-    oneWire.reset();
-    oneWire.skip();
-    oneWire.write(STARTCONVO, true);
-
-    Sleepy::loseSomeTime(DS18B_READ_TIME_MS);
-  }
-
   // returns temperature in 1/10 degrees C or DS18_INVALID_TEMP if the
-  // device's scratch pad cannot be read successfully.
-  inline int16_t getTemp(const uint8_t* deviceAddress) {
-    ScratchPad scratchPad;
-
+  // device's scratch pad cannot be read successfully. The scratch pad read is
+  // returned in scratchPad.
+  inline int16_t getTemp(const uint8_t* deviceAddress, uint8_t* scratchPad) {
     if (!isConnected(deviceAddress, scratchPad)) {
       return DS18B_INVALID_TEMP;
     }
@@ -804,16 +1148,8 @@ protected:
 
     oneWire.reset();
 
-#if DEBUG
-    Serial.print(F("DS18B data: "));
-    scratchPad -= 9;
-    for (uint8_t i=0; i<9; i++) {
-      Serial.print(scratchPad[i], DEC);
-      Serial.print(F(" "));
-    }
-    Serial.println();
-    serialFlush();
-#endif
+    // raw temperature
+    TRACE_EVENT(TRACE_SENSORS, ((uint16_t) scratchPad[-8] << 8) | scratchPad[-9]);
   }
 
   // writes device's scratch pad
@@ -826,6 +1162,11 @@ protected:
     // DS1820 and DS18S20 have no configuration register
     if (deviceAddress[0] != DS18S20MODEL) oneWire.write(scratchPad[CONFIGURATION]); // configuration
     oneWire.reset();
+
+    // the sensor keeps its scratchpad while it's powered, so the values only need
+    // saving to its eeprom if it's going to be switched off
+    if (!switchedPower) return;
+
     oneWire.select(deviceAddress); //<--this line was missing
     // save the newly written values to eeprom
     oneWire.write(COPYSCRATCH, true);
@@ -840,76 +1181,210 @@ protected:
 #define BUS_SWITCHED_POWER 1
 #define BUS_I2C 2
 
+#define AUTODETECT_PORTS 4
+
+/**********************************************************************************
+ * Detects the type of sensor attached to each port.
+ *
+ * All ports are probed together. The bus characterisation and sensor power-up
+ * waits are shared between the ports, so probing 4 ports takes about as long
+ * as probing 1. The usual I2C addresses are tried before falling back to a scan
+ * of the whole I2C address range.
+ *
+ * probePorts() takes the last known result for each port (e.g. from portSensor[]).
+ * A port with a previously detected sensor type is only checked for that sensor
+ * and is fully probed again only if it's no longer there. SENSOR_AUTO ports are
+ * fully probed and ports configured as anything else are left alone.
+ */
 class Autodetect : public PortI2C {
 
 public:
 	Autodetect() : PortI2C(1) {
 	}
 	
-	void probePorts(byte typeList[4]) {
-		for (byte port = 0; port <4; port++) {
-			typeList[port] = probePort(port + 1);
+	// true if type is one that's found by autodetection rather than configured
+	static bool isDetectedType(byte type) {
+		switch (type) {
+		case SENSOR_DHT11:
+		case SENSOR_DHT22:
+		case SENSOR_DS18B:
+		case SENSOR_HYT131:
+		case SENSOR_BMP085:
+		case SENSOR_LCD:
+		case SENSOR_RTC:
+		case SENSOR_I2C_UNKNOWN:
+			return true;
+		default:
+			return false;
+		}
+	}
+
+	// typeList holds the last known type for each port and is updated with the detected types
+	void probePorts(byte typeList[AUTODETECT_PORTS]) {
+		byte mismatched = probe(typeList);
+
+		if (mismatched) {
+			// cached sensors that have gone need a full probe
+			for (byte p = 0; p < AUTODETECT_PORTS; p++) {
+				if (mismatched & bit(p)) typeList[p] = SENSOR_AUTO;
+			}
+			probe(typeList);
 		}
 	}
 	
+	// quick check that the I2C devices in typeList still answer, without probing
+	// anything else. Returns a bit set for each port whose device has gone.
+	byte checkI2CDevices(const byte typeList[AUTODETECT_PORTS]) {
+		byte missing = 0;
+
+		for (byte p = 0; p < AUTODETECT_PORTS; p++) {
+			byte addr = i2cAddress(typeList[p]);
+			if (addr == 0) continue;
+
+			selectPort(p);
+			if (!initI2C() || !checkI2C(addr)) missing |= bit(p);
+
+			// leave the pins as probe() does
+			mode2(INPUT);
+			digiWrite2(LOW);
+			mode(INPUT);
+			digiWrite(LOW);
+		}
+
+		return missing;
+	}
+
 	byte probePort(byte portNum) {
-		this->portNum = portNum;
-		
-		byte type = SENSOR_NONE;
-		
-		// determine what kind of bus we have
-		byte bus = determineBus();
+		byte typeList[AUTODETECT_PORTS];
+
+		for (byte p = 0; p < AUTODETECT_PORTS; p++) {
+			typeList[p] = SENSOR_NONE;
+		}
+		typeList[portNum - 1] = SENSOR_AUTO;
+
+		probePorts(typeList);
+
+		return typeList[portNum - 1];
+	}
+	
+private:
+	inline void selectPort(byte p) {
+		portNum = p + 1;
+	}
+
+	// probe the ports in typeList that are auto or have a cached type.
+	// Returns a bit set for each port whose cached sensor wasn't found.
+	byte probe(byte typeList[AUTODETECT_PORTS]) {
+		byte probeMask = 0;    // ports needing a full probe
+		byte powerMask = 0;    // ports to probe for switched power sensors
+		byte cachedMask = 0;   // ports with a cached type to verify
+		byte cachedType[AUTODETECT_PORTS];
+
+		for (byte p = 0; p < AUTODETECT_PORTS; p++) {
+			cachedType[p] = typeList[p];
+
+			if (typeList[p] == SENSOR_AUTO) {
+				probeMask |= bit(p);
+			}
+			else if (isDetectedType(typeList[p])) {
+				cachedMask |= bit(p);
+
+				if (i2cAddress(typeList[p]) != 0) {
+					// an I2C device only needs a check of its address
+					selectPort(p);
+					if (!initI2C() || !checkI2C(i2cAddress(typeList[p]))) {
+						typeList[p] = SENSOR_NONE;
+					}
+				}
+				else {
+					powerMask |= bit(p);
+				}
+			}
+		}
+
+		// determine what kind of bus each port has
+		byte busList[AUTODETECT_PORTS];
+		determineBuses(probeMask, busList);
 
-		if (bus == BUS_I2C) {
-      #if DEBUG
-        Serial.print(F(" (I2C) "));
-        Serial.flush();
-      #endif
+		for (byte p = 0; p < AUTODETECT_PORTS; p++) {
+			if (!(probeMask & bit(p))) continue;
 
-			type = probeI2C();
+			typeList[p] = SENSOR_NONE;
+			selectPort(p);
+
+			if (busList[p] == BUS_I2C) {
+				typeList[p] = probeI2C();
 
-			if (type == SENSOR_NONE) {
 				// maybe not an i2c bus after all
-				type = probeSwitchedPower();
+				if (typeList[p] == SENSOR_NONE) powerMask |= bit(p);
+			}
+			else if (busList[p] == BUS_SWITCHED_POWER) {
+				powerMask |= bit(p);
 			}
 		}
-		else if (bus == BUS_SWITCHED_POWER) {
-      #if DEBUG
-			  Serial.print(F(" (SwPwr) "));
-			  Serial.flush();
-      #endif
 
-			type = probeSwitchedPower();
+		probeSwitchedPower(powerMask, typeList);
+
+		byte mismatched = 0;
+
+		for (byte p = 0; p < AUTODETECT_PORTS; p++) {
+			if (!((probeMask | cachedMask) & bit(p))) continue;
+
+			if ((cachedMask & bit(p)) && typeList[p] != cachedType[p]) {
+				mismatched |= bit(p);
+			}
+
+			// turn off A pin power
+			selectPort(p);
+			mode2(INPUT);
+			digiWrite2(LOW);
+		
+			// ensure data pin doesn't have a pull-up configured
+			mode(INPUT);
+			digiWrite(LOW);
 		}
-#if DEBUG
-		else {
-			Serial.print(F(" (Unknown) "));
+
+		return mismatched;
+	}
+
+	// I2C address of a detected sensor type, or 0 if it's not an I2C device
+	static byte i2cAddress(byte type) {
+		switch (type) {
+		case SENSOR_HYT131: return I2C_HYT131;
+		case SENSOR_BMP085: return I2C_BMP085;
+		case SENSOR_LCD: return I2C_LCD;
+		case SENSOR_RTC: return I2C_RTC;
+		default: return 0;
 		}
-#endif
-		
-		// turn off A pin power
-		mode2(INPUT);
-		digiWrite2(LOW);
-		
-		// ensure data pin doesn't have a pull-up configured
-		mode(INPUT);
-		digiWrite(LOW);		
-		
-		return type;
 	}
-	
-private:
-	byte probeI2C(void) {
-		byte type = SENSOR_NONE;
 
-		// set up I2C bus
+	// set up the I2C bus on the current port. Returns false if SDA isn't high as
+	// it should be, i.e. it doesn't look like an I2C bus.
+	bool initI2C(void) {
 		sdaOut(1);
 		mode2(OUTPUT);
 		sclHi();
 		delay(1);
 
-		// check if this is really an I2C bus. SDA should be high at this point
-		if (sdaIn()) {
+		return sdaIn();
+	}
+
+	byte probeI2C(void) {
+		byte type = SENSOR_NONE;
+
+#if DEBUG
+		Serial.print(F(" (I2C) "));
+		Serial.flush();
+#endif
+
+		// check if this is really an I2C bus
+		if (initI2C()) {
+
+			// try the devices we know about first as scanning all addresses is slow
+			if (checkI2C(I2C_HYT131)) return SENSOR_HYT131;
+			if (checkI2C(I2C_BMP085)) return SENSOR_BMP085;
+			if (checkI2C(I2C_LCD)) return SENSOR_LCD;
+			if (checkI2C(I2C_RTC)) return SENSOR_RTC;
 
 			// check all addresses
 			// if more than one responds, assume it's not an I2C bus as we're assuming one device per port
@@ -929,111 +1404,165 @@ private:
 			}
 
 			if (activeAddr >= MIN_I2C_ADDR && activeAddr <= MAX_I2C_ADDR) {
-				switch (activeAddr) {
-				case I2C_HYT131: type = SENSOR_HYT131; break;
-				case I2C_LCD: type = SENSOR_LCD; break;
-				case I2C_RTC: type = SENSOR_RTC; break;
-				default: type = SENSOR_I2C_UNKNOWN;
-				}
+				type = SENSOR_I2C_UNKNOWN;
 			}
 		}
 
 		return type;
 	}
 
-	byte probeSwitchedPower(void) {
-		byte type = SENSOR_NONE;
+	// look for DS18B and DHT sensors on the ports in portMask, powering them all up together
+	void probeSwitchedPower(byte portMask, byte typeList[AUTODETECT_PORTS]) {
+		if (portMask == 0) return;
 
-		// set up bus
-		mode(INPUT);
-		digiWrite(LOW);
+		for (byte p = 0; p < AUTODETECT_PORTS; p++) {
+			if (!(portMask & bit(p))) continue;
+
+			selectPort(p);
+
+			// set up bus
+			mode(INPUT);
+			digiWrite(LOW);
+
+			// turn on A pin power
+			mode2(OUTPUT);
+			digiWrite2(HIGH);
+		}
 
-		// turn on A pin power
-		mode2(OUTPUT);
-		digiWrite2(HIGH);
 		Sleepy::loseSomeTime(DS18B_POWERUP_TIME_MS);
 
 		// 1. check for a OneWire bus (DS18B20 sensors)
-		OneWire oneWire;
-		oneWire.init(digiPin());
-		DeviceAddress ds18Addr;
+		byte dhtMask = 0;
 
-		if (oneWire.search(ds18Addr) &&
-			oneWire.crc8(ds18Addr, 7) == ds18Addr[7]) {
+		for (byte p = 0; p < AUTODETECT_PORTS; p++) {
+			if (!(portMask & bit(p))) continue;
 
-			type = SENSOR_DS18B;
-		}
+			selectPort(p);
 
-		if (type == SENSOR_NONE) {
-			// 2. then for DHT11/22
+#if DEBUG
+			Serial.print(F(" (SwPwr) "));
+			Serial.flush();
+#endif
 
-			// Set data pin as an output initially for signalling sensor to take a reading.
-			// Start with output high.
-			mode(OUTPUT);
-			digiWrite(HIGH);
-			Sleepy::loseSomeTime(1000);
+			OneWire oneWire;
+			oneWire.init(digiPin());
+			DeviceAddress ds18Addr;
+
+			if (oneWire.search(ds18Addr) &&
+				oneWire.crc8(ds18Addr, 7) == ds18Addr[7]) {
 
-			type = DHT::testPort(portNum);
+				typeList[p] = SENSOR_DS18B;
+			}
+			else {
+				// Set data pin as an output initially for signalling sensor to take a reading.
+				// Start with output high.
+				mode(OUTPUT);
+				digiWrite(HIGH);
+				dhtMask |= bit(p);
+			}
 		}
 
-		return type;
+		if (dhtMask == 0) return;
+
+		// 2. then for DHT11/22, which need time to stabilise after power up
+		Sleepy::loseSomeTime(DHT_POWERUP_TIME_MS);
+
+		for (byte p = 0; p < AUTODETECT_PORTS; p++) {
+			if (dhtMask & bit(p)) typeList[p] = DHT::testPort(p + 1);
+		}
 	}
 
-	byte determineBus(void) {
-		// set DIO (SDA) to a floating input
-		mode(INPUT);
-		digiWrite(LOW);
+	// characterise the bus on each port in portMask by checking how the D pin
+	// responds to the A pin and the pull-up. The ports share the waits.
+	void determineBuses(byte portMask, byte busList[AUTODETECT_PORTS]) {
+		byte DFWhenALow = 0, DPWhenALow = 0, DPWhenAHigh = 0, DFWhenAHigh = 0;
+
+		if (portMask == 0) return;
+
+		for (byte p = 0; p < AUTODETECT_PORTS; p++) {
+			if (!(portMask & bit(p))) continue;
+			selectPort(p);
+
+			// set DIO (SDA) to a floating input
+			mode(INPUT);
+			digiWrite(LOW);
 		
-		// set AIO (power/SCL) low
-		mode2(OUTPUT);
-		digiWrite2(LOW);
+			// set AIO (power/SCL) low
+			mode2(OUTPUT);
+			digiWrite2(LOW);
+		}
 		
 		// check what's on DIO
 		delay(DS18B_POWERUP_TIME_MS);
-		byte DFWhenALow = digiRead();
+		for (byte p = 0; p < AUTODETECT_PORTS; p++) {
+			if (!(portMask & bit(p))) continue;
+			selectPort(p);
+
+			if (digiRead()) DFWhenALow |= bit(p);
 
-		// pull up DIO
-		digiWrite(HIGH);
+			// pull up DIO
+			digiWrite(HIGH);
+		}
 		
 		// check what's on DIO
 		delay(DS18B_POWERUP_TIME_MS);
-		byte DPWhenALow = digiRead();
-		
-		// set AIO (power/SCL) high
-		digiWrite2(HIGH);
+		for (byte p = 0; p < AUTODETECT_PORTS; p++) {
+			if (!(portMask & bit(p))) continue;
+			selectPort(p);
+
+			if (digiRead()) DPWhenALow |= bit(p);
+
+			// set AIO (power/SCL) high
+			digiWrite2(HIGH);
+		}
 		
 		// check what's on DIO
 		delay(DS18B_POWERUP_TIME_MS);
-		byte DPWhenAHigh = digiRead();
+		for (byte p = 0; p < AUTODETECT_PORTS; p++) {
+			if (!(portMask & bit(p))) continue;
+			selectPort(p);
 
-		// and DIO back to floating
-		digiWrite(LOW);
+			if (digiRead()) DPWhenAHigh |= bit(p);
+
+			// and DIO back to floating
+			digiWrite(LOW);
+		}
 
 		// check what's on DIO
 		delay(DS18B_POWERUP_TIME_MS);
-		byte DFWhenAHigh = digiRead();
+		for (byte p = 0; p < AUTODETECT_PORTS; p++) {
+			if (!(portMask & bit(p))) continue;
+			selectPort(p);
+
+			if (digiRead()) DFWhenAHigh |= bit(p);
+		}
+
+		// what does it all mean?
+		for (byte p = 0; p < AUTODETECT_PORTS; p++) {
+			byte b = bit(p);
 
 #if DEBUG
-		Serial.print(DFWhenAHigh ? "H" : "L");
-		Serial.print(DFWhenALow ? "H" : "L");
-		Serial.print(DPWhenAHigh ? "H" : "L");
-		Serial.print(DPWhenALow ? "H" : "L");
+			if (portMask & b) {
+				Serial.print(DFWhenAHigh & b ? "H" : "L");
+				Serial.print(DFWhenALow & b ? "H" : "L");
+				Serial.print(DPWhenAHigh & b ? "H" : "L");
+				Serial.println(DPWhenALow & b ? "H" : "L");
+			}
 #endif
-		
-		// what does it all mean?
-		if (DFWhenAHigh && !DFWhenALow && DPWhenAHigh && !DPWhenALow) {
-			// looks like A is connected to D (via pullup resistor)
-			return BUS_SWITCHED_POWER;
-		}
-		else if (DPWhenAHigh && DPWhenALow) {
-			// A doesn't seem to affect D
-			return BUS_I2C;
-		}
-		else {
-			// D pulled low when not expected
-			return BUS_UNKNOWN;
+
+			if ((DFWhenAHigh & b) && !(DFWhenALow & b) && (DPWhenAHigh & b) && !(DPWhenALow & b)) {
+				// looks like A is connected to D (via pullup resistor)
+				busList[p] = BUS_SWITCHED_POWER;
+			}
+			else if ((DPWhenAHigh & b) && (DPWhenALow & b)) {
+				// A doesn't seem to affect D
+				busList[p] = BUS_I2C;
+			}
+			else {
+				// D pulled low when not expected
+				busList[p] = BUS_UNKNOWN;
+			}
 		}
-		
 	}
 
 	// takes a 7 bit address
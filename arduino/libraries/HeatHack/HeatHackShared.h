@@ -4,8 +4,17 @@
 #include <Arduino.h>
 #include <HeatHack.h>
 #include <HeatHackSensors.h>
+#include <HeatHackTrace.h>
+#include <HeatHackSecure.h>
+#include <HeatHackChannel.h>
+#include <HeatHackRate.h>
 #include <avr/sleep.h>
 #include <avr/eeprom.h>
+#include <util/crc16.h>
+
+#if !defined(__AVR_ATtiny84__)
+#include <PinChange.h>
+#endif
 
 /////////////////////////////////////////////////////////////////////
 // Functions and variables shared between standard and micro Jeenodes
@@ -23,8 +32,16 @@ static uint8_t myInterval;     // interval between transmissions in 10s of secs
 
 static uint8_t portSensor[4];  // type of sensor attached to each port
 static uint8_t eepromFlags;
+static uint16_t myExtNodeID;   // extended node id, or 0 if myNodeID is the node's id
+#else
+static const uint16_t myExtNodeID = 0;
 #endif
 
+// the node's id as the receiver reports it
+inline uint16_t nodeID(void) {
+  return myExtNodeID ? myExtNodeID : myNodeID;
+}
+
 
 // interrupt handler for the Sleepy watchdog
 ISR(WDT_vect) { Sleepy::watchdogEvent(); }
@@ -37,9 +54,32 @@ static bool hibernating = false;
 
 static HeatHackData dataPacket;
 
+// set when a key press on the serial port wakes the node (see enableConsoleWake)
+static volatile bool consoleRequested = false;
+
 // default to maximum power
 static uint8_t transmitPower = 0;
 
+#if TRACE
+// set when the receiver asks for the event trace in an ack
+static bool traceRequested = false;
+#endif
+
+#if TIME_SYNC
+// the receiver's clock, from the last ack that carried it (see receiverTime)
+static bool timeSynced = false;
+static uint32_t syncMillis;          // millis() when the ack arrived
+static uint32_t syncReceiverMillis;  // the receiver's millis() in the ack
+static int16_t clockTrim = 0;        // how much faster the receiver's clock runs, in 1024ths
+#endif
+
+// longest config console command, which is the k command with a 32 digit key
+#if SECURE
+#define CONSOLE_BUFFER_SIZE 34
+#else
+#define CONSOLE_BUFFER_SIZE 10
+#endif
+
 // count number of successive times a doReport fails on the initial try and has to retry.
 // If it happens several times then recalc min transmit power
 static uint8_t successiveRetries = 0;
@@ -63,17 +103,320 @@ void flashLED(uint8_t numFlashes = 1) {
 #endif
 }
 
+/////////////////////////////////////////////////////////////////////
+// true if the packet just received is a broadcast ack to the node with the given id,
+// as sent for packets that went to the receiver with RF12_HDR_DST. The id is in front
+// of the ack data. The RF12 id in the header is the receiver's, or a repeater's when
+// it acks on the receiver's behalf.
+inline bool isBroadcastAckTo(uint16_t id) {
+  return (rf12_hdr & ~RF12_HDR_MASK) == RF12_HDR_CTL && rf12_len >= 2 &&
+         rf12_data[0] == (id & 0xFF) && rf12_data[1] == (id >> 8);
+}
+
+/////////////////////////////////////////////////////////////////////
+// true if the packet just received is the receiver's ack to this node. An extended
+// node's ack is broadcast with its id in front of the ack data, which is skipped.
+inline bool isAckToMe(uint8_t& dataStart) {
+  if (myExtNodeID) {
+    dataStart = 2;
+    return isBroadcastAckTo(myExtNodeID);
+  }
+
+  dataStart = 0;
+  return rf12_hdr == (RF12_HDR_DST | RF12_HDR_CTL | myNodeID);
+}
+
+#if TIME_SYNC
+/////////////////////////////////////////////////////////////////////
+// the receiver's millis() now. The node's own millis() is only roughly kept up to date
+// while it sleeps, as the watchdog is only good to 10% or so, so the time since the
+// last sync is corrected by how fast the receiver's clock has been running.
+uint32_t receiverTime(void) {
+  int32_t elapsed = millis() - syncMillis;
+  return syncReceiverMillis + elapsed + ((elapsed * clockTrim) >> 10);
+}
+
+/////////////////////////////////////////////////////////////////////
+// true if the receiver's clock is known
+inline bool haveReceiverTime(void) {
+  return timeSynced && millis() - syncMillis < TIME_SYNC_VALID_MS;
+}
+
+/////////////////////////////////////////////////////////////////////
+// set the receiver's clock from an ack, and measure its rate against the node's
+void syncClock(uint32_t receiverMillis) {
+  uint32_t now = millis();
+
+  if (haveReceiverTime()) {
+    int32_t elapsed = now - syncMillis;
+    int32_t drift = (int32_t) (receiverMillis - syncReceiverMillis) - elapsed;
+
+    // a big drift means the receiver's restarted
+    if (elapsed >= TIME_SYNC_MIN_MS && drift > -elapsed / 4 && drift < elapsed / 4) {
+      clockTrim = (clockTrim + (int16_t) ((drift << 10) / elapsed)) / 2;
+    }
+  }
+
+  TRACE_EVENT(TRACE_SHARED, clockTrim);
+
+  syncMillis = now;
+  syncReceiverMillis = receiverMillis;
+  timeSynced = true;
+}
+
+/////////////////////////////////////////////////////////////////////
+// add the time by the receiver's clock to dataPacket, as a SAMPLE_TIME reading.
+// Returns true if it was added.
+bool addSampleTime(void) {
+  if (!haveReceiverTime() || dataPacket.numReadings >= HH_MAX_READINGS) return false;
+
+  HHReading reading;
+  reading.header = 0;
+  reading.sensorType = HHSensorType::SAMPLE_TIME;
+  reading.encodedReading = receiverTime() / 1000;
+  dataPacket.addReading(reading);
+  return true;
+}
+
+/////////////////////////////////////////////////////////////////////
+// the main receiver's clock, which is its own millis() on the main receiver
+uint32_t mainReceiverTime(void) {
+#if RECEIVER_NODE
+  if (eepromFlags & FLAG_ACK) return millis();
+#endif
+  return receiverTime();
+}
+
+/////////////////////////////////////////////////////////////////////
+// true if the main receiver's clock is known
+inline bool haveMainReceiverTime(void) {
+#if RECEIVER_NODE
+  if (eepromFlags & FLAG_ACK) return true;
+#endif
+  return haveReceiverTime();
+}
+#endif
+
+#if CHANNEL_PLAN || ADAPTIVE_RATE
+// longest to wait for a packet that's coming in before retuning anyway, as the
+// channel may be jammed. A whole packet takes about 12 ms.
+#define RADIO_STOP_WAIT_MS 20
+
+/////////////////////////////////////////////////////////////////////
+// true once the receiver's been stopped so the radio can be retuned, which waits
+// for a packet that's coming in. Call it just after rf12_recvDone(); the next call
+// to that turns the receiver back on.
+bool radioCanRetune(void) {
+  static bool waiting = false;
+  static uint32_t waitingSince;
+
+  if (rf12_canSend() || (waiting && millis() - waitingSince > RADIO_STOP_WAIT_MS)) {
+    rf12_sleep(RF12_WAKEUP);
+    waiting = false;
+    return true;
+  }
+
+  if (!waiting) {
+    waiting = true;
+    waitingSince = millis();
+  }
+  return false;
+}
+#endif
+
+#if CHANNEL_PLAN
+
+/////////////////////////////////////////////////////////////////////
+// the group's moving to the channel at the given time, from an ack
+void channelAnnounced(uint8_t channel, uint32_t at) {
+  if (channel >= CHANNEL_COUNT) return;
+
+  channelNext = channel;
+  channelMoveAt = at;
+  channelMovePending = true;
+}
+
+/////////////////////////////////////////////////////////////////////
+// move to the group's new channel once it's time. Without the receiver's clock
+// there's no telling, so the move's made straight away.
+void channelMoveIfDue(void) {
+  if (!channelMovePending) return;
+  if (haveMainReceiverTime() && (int32_t) (mainReceiverTime() - channelMoveAt) < 0) return;
+
+  groupChannel = channelNext;
+  channelMovePending = false;
+  channelLost = false;
+
+  TRACE_EVENT(TRACE_SHARED, groupChannel);
+}
+
+/////////////////////////////////////////////////////////////////////
+// go back to the rendezvous channel after losing contact with the receiver
+void channelFallBack(void) {
+  groupChannel = 0;
+  channelLost = true;
+
+  TRACE_EVENT(TRACE_SHARED, channelLost);
+}
+
+/////////////////////////////////////////////////////////////////////
+// true during the main receiver's visits to the rendezvous channel
+inline bool inRendezvous(void) {
+  return haveMainReceiverTime() && mainReceiverTime() % CHANNEL_RENDEZVOUS_MS < CHANNEL_RENDEZVOUS_LISTEN_MS;
+}
+
+/////////////////////////////////////////////////////////////////////
+// the channel a receiver or repeater should be listening on now
+inline uint8_t channelListening(void) {
+  return groupChannel != 0 && inRendezvous() ? 0 : groupChannel;
+}
+
+/////////////////////////////////////////////////////////////////////
+// put an ACK_CHANNEL in an ack if the group's moving, or if the ack's sent from a
+// visit to the rendezvous channel. Returns the number of bytes added.
+uint8_t addChannelAck(uint8_t* ack) {
+  if (!haveMainReceiverTime()) return 0;
+
+  uint32_t at;
+  if (channelMovePending) {
+    ack[1] = channelNext;
+    at = channelMoveAt;
+  }
+  else if (channelTuned != groupChannel) {
+    ack[1] = groupChannel;
+    at = mainReceiverTime();
+  }
+  else {
+    return 0;
+  }
+
+  ack[0] = ACK_CHANNEL;
+  memcpy(&ack[2], &at, sizeof(at));
+  return 2 + sizeof(at);
+}
+
+/////////////////////////////////////////////////////////////////////
+// sleep until the middle of the receiver's next visit to the rendezvous channel.
+// The node's sleeps don't run at the receiver's rate, which clockTrim allows for.
+void sleepUntilRendezvous(void) {
+  if (!haveReceiverTime()) return;
+
+  int32_t wait = (CHANNEL_RENDEZVOUS_LISTEN_MS / 2 + CHANNEL_RENDEZVOUS_MS - receiverTime() % CHANNEL_RENDEZVOUS_MS) % CHANNEL_RENDEZVOUS_MS;
+  wait -= (wait * clockTrim) >> 10;
+
+  TRACE_EVENT(TRACE_SHARED, wait);
+
+  if (wait > 16) Sleepy::loseSomeTime(wait);
+}
+#endif
+
+#if ADAPTIVE_RATE
+/////////////////////////////////////////////////////////////////////
+// the faster step whose window the main receiver's clock is in, or 0
+uint8_t rateWindow(void) {
+  if (!haveMainReceiverTime()) return 0;
+
+  uint16_t left = RATE_PERIOD_MS - mainReceiverTime() % RATE_PERIOD_MS;
+  uint8_t step = (left - 1) / RATE_WINDOW_MS + 1;
+  return step < RATE_STEPS ? step : 0;
+}
+
+/////////////////////////////////////////////////////////////////////
+// sleep until the middle of a faster step's window, or for step 0 until the
+// windows are over if it's in one
+void sleepUntilRateWindow(uint8_t step) {
+  if (!haveReceiverTime()) return;
+
+  uint16_t phase = receiverTime() % RATE_PERIOD_MS;
+  int32_t wait;
+
+  if (step > 0) {
+    uint16_t middle = RATE_PERIOD_MS - step * RATE_WINDOW_MS + RATE_WINDOW_MS / 2;
+    wait = (middle + RATE_PERIOD_MS - phase) % RATE_PERIOD_MS;
+  }
+  else {
+    wait = phase >= RATE_PERIOD_MS - (RATE_STEPS - 1) * RATE_WINDOW_MS ? RATE_PERIOD_MS - phase : 0;
+  }
+  wait -= (wait * clockTrim) >> 10;
+
+  TRACE_EVENT(TRACE_SHARED, wait);
+
+  if (wait > 16) Sleepy::loseSomeTime(wait);
+}
+#endif
+
+/////////////////////////////////////////////////////////////////////
+// act on the data in an ack to this node, from dataStart
+void readAckData(uint8_t dataStart) {
+  uint8_t i = dataStart;
+
+  while (i < rf12_len) {
+    switch (rf12_data[i]) {
+
+    case ACK_TIME_SYNC:
+      if (i + 1 + sizeof(uint32_t) > rf12_len) return;
+#if TIME_SYNC
+      {
+      uint32_t receiverMillis;
+      memcpy(&receiverMillis, (const void*) &rf12_data[i + 1], sizeof(uint32_t));
+      syncClock(receiverMillis);
+      }
+#endif
+      i += 1 + sizeof(uint32_t);
+      break;
+
+    case ACK_CHANNEL:
+      if (i + 2 + sizeof(uint32_t) > rf12_len) return;
+#if CHANNEL_PLAN
+      {
+      uint32_t at;
+      memcpy(&at, (const void*) &rf12_data[i + 2], sizeof(uint32_t));
+      channelAnnounced(rf12_data[i + 1], at);
+      }
+#endif
+      i += 2 + sizeof(uint32_t);
+      break;
+
+    case ACK_RATE:
+      if (i + 2 > rf12_len) return;
+#if ADAPTIVE_RATE
+      if (rf12_data[i + 1] < RATE_STEPS) rateStep = rf12_data[i + 1];
+#endif
+      i += 2;
+      break;
+
+    case ACK_TRACE_REQUEST:
+#if TRACE
+      traceRequested = true;
+#endif
+      i++;
+      break;
+
+    default:
+      return;
+    }
+  }
+}
+
 /////////////////////////////////////////////////////////////////////
 // wait a few milliseconds for proper ACK to me, return true if indeed received
 bool waitForAck(void) {
     uint32_t ackTimer = millis();
+    uint8_t dataStart;
 
     do {
         if (rf12_recvDone() &&
             rf12_crc == 0 &&
-            rf12_hdr == (RF12_HDR_DST | RF12_HDR_CTL | myNodeID)) {
+            isAckToMe(dataStart)) {
               
           // see http://talk.jeelabs.net/topic/811#post-4712
+
+          readAckData(dataStart);
+
+#if CHANNEL_PLAN
+          // an ack that doesn't say the group's elsewhere means it's on this channel
+          if (!channelMovePending) channelLost = false;
+#endif
     
           lastAckTime = millis();
           return true;
@@ -87,6 +430,56 @@ bool waitForAck(void) {
 }
 
 
+/////////////////////////////////////////////////////////////////////
+// send dataPacket and ask for an ack. An extended node sends it to the receiver with
+// its id in front.
+void sendDataPacket(void) {
+#if SECURE
+  // secured in a copy as dataPacket is sent again if there's no ack. Test packets
+  // aren't secured (see HeatHackSecure.h).
+  byte packet[sizeof(HHExtHeader) + sizeof(HeatHackData) + SECURE_TRAILER];
+  byte pos = 0;
+  byte hdr = RF12_HDR_ACK;
+
+  if (myExtNodeID) {
+    HHExtHeader *header = (HHExtHeader *)packet;
+    header->kind = HH_PACKET_DATA;
+    header->nodeId = myExtNodeID;
+    pos = sizeof(HHExtHeader);
+    hdr = RF12_HDR_DST | RF12_HDR_ACK | RECEIVER_NODE_ID;
+  }
+
+  byte len = dataPacket.getTransmitSize();
+  memcpy(&packet[pos], &dataPacket, len);
+
+  if (!(dataPacket.numReadings == 1 && dataPacket.readings[0].sensorType == HHSensorType::TEST)) {
+    len = secureSeal(nodeID(), secureNextCounter(), &packet[pos], len);
+  }
+
+  rf12_sendNow(hdr, packet, pos + len);
+#else
+
+#if !defined(__AVR_ATtiny84__)
+  if (myExtNodeID) {
+    struct {
+      HHExtHeader header;
+      HeatHackData data;
+    } packet;
+
+    packet.header.kind = HH_PACKET_DATA;
+    packet.header.nodeId = myExtNodeID;
+    memcpy(&packet.data, &dataPacket, dataPacket.getTransmitSize());
+
+    rf12_sendNow(RF12_HDR_DST | RF12_HDR_ACK | RECEIVER_NODE_ID, &packet,
+                 sizeof(HHExtHeader) + dataPacket.getTransmitSize());
+    return;
+  }
+#endif
+
+  rf12_sendNow(RF12_HDR_ACK, &dataPacket, dataPacket.getTransmitSize());
+#endif
+}
+
 /////////////////////////////////////////////////////////////////////
 void serialFlush (void) {
   Serial.flush();
@@ -108,10 +501,7 @@ uint8_t findMinTransmitPower(void) {
   dataPacket.clear();
   dataPacket.addReading(reading);
 
-#if DEBUG
-  Serial.println(F("Finding min transmit power (0=max)"));
-  Serial.flush();
-#endif
+  TRACE_EVENT(TRACE_SHARED, 0);
 	
   do {
 		// try twice at each power level to check for consistency
@@ -120,20 +510,13 @@ uint8_t findMinTransmitPower(void) {
 
 	    rf12_sleep(RF12_WAKEUP);
 	    rf12_control(0x9850 | txPower); // set radio's transmit power
-      rf12_sendNow(RF12_HDR_ACK, &dataPacket, dataPacket.getTransmitSize());
+      sendDataPacket();
 			rf12_sendWait(RADIO_SYNC_MODE);
 			if (waitForAck()) ackCount++;
 	    rf12_sleep(RF12_SLEEP);
 
-      #if DEBUG
-        Serial.print(F("  power "));
-        Serial.print(txPower);
-        Serial.print(F(" try "));
-        Serial.print(3 - tries);
-        Serial.print(F(" acks "));
-        Serial.println(ackCount);
-        Serial.flush();
-      #endif
+      // power in the high byte, acks so far in the low byte
+      TRACE_EVENT(TRACE_SHARED, (txPower << 8) | ackCount);
 
       Sleepy::loseSomeTime(POWER_RETRY_PERIOD);
 		}
@@ -146,14 +529,7 @@ uint8_t findMinTransmitPower(void) {
   while (txPower >= 0 && txPower <= 7 && ackCount < 2);
 
 
-#if DEBUG
-  if (txPower == NO_RESPONSE) Serial.println(F("No response from receiver"));
-  else {
-    Serial.print(F("Using power "));
-    Serial.println(txPower);
-  }
-  Serial.flush();
-#endif
+  TRACE_EVENT(TRACE_SHARED, txPower);
 
   return txPower;
 }
@@ -171,6 +547,36 @@ inline void setMaxTransmitPower(void) {
 }
 
 
+#if TRACE
+/////////////////////////////////////////////////////////////////////
+// send the event trace to the receiver, oldest events first
+void sendTrace(void) {
+  struct {
+    HHExtHeader header;
+    TraceEvent events[TRACE_EVENTS_PER_PACKET];
+  } packet;
+
+  packet.header.kind = HH_PACKET_TRACE;
+  packet.header.nodeId = nodeID();
+  uint8_t first = 0;
+  uint8_t n;
+
+  rf12_sleep(RF12_WAKEUP);
+  setMaxTransmitPower();
+
+  while ((n = traceCopy(packet.events, first, TRACE_EVENTS_PER_PACKET)) > 0) {
+    rf12_sendNow(RF12_HDR_DST | RECEIVER_NODE_ID, &packet, sizeof(HHExtHeader) + n * sizeof(TraceEvent));
+    rf12_sendWait(RADIO_SYNC_MODE);
+    first += n;
+
+    // give the receiver time to print it
+    Sleepy::loseSomeTime(TRACE_PACKET_GAP_MS);
+  }
+
+  rf12_sleep(RF12_SLEEP);
+}
+#endif
+
 /////////////////////////////////////////////////////////////////////
 // periodic report, i.e. send out a packet and optionally report on serial port
 inline void doReport(void) {
@@ -204,6 +610,25 @@ inline void doReport(void) {
     return;
   }
 
+#if SECURE
+  // the receiver rejects anything that isn't secured with the group's key, so without
+  // one there's no point sending, or retrying at full power. Set it with the config
+  // console's k command.
+  if (!secureKeySet) {
+    TRACE_EVENT(TRACE_SHARED, 0xFFFF);
+    if (eepromFlags & FLAG_VERBOSE) {
+      Serial.println(F("No security key set, so the readings weren't sent"));
+      serialFlush();
+    }
+    return;
+  }
+#endif
+
+#if TIME_SYNC
+  // the sample time only goes in the radio packet, it's taken off again afterwards
+  bool addedTime = addSampleTime();
+#endif
+
   bool acked = false;
   byte retry = 0;
 
@@ -212,10 +637,8 @@ inline void doReport(void) {
       setTransmitPower(transmitPower);
     }
     else {
-#if DEBUG
-      Serial.println("No Ack received. Resending at max power.");
-      Serial.flush();
-#endif
+      // no ack, so resending at max power
+      TRACE_EVENT(TRACE_SHARED, retry);
 
       // use maximum power for retries
       setMaxTransmitPower();
@@ -225,20 +648,61 @@ inline void doReport(void) {
   //dataPacket.isRetransmit = true;
     }
 
+#if CHANNEL_PLAN
+    // on the rendezvous channel the receiver's only listening now and then
+    channelMoveIfDue();
+    tuneChannel(groupChannel);
+    if (channelLost) sleepUntilRendezvous();
+#endif
+
+#if ADAPTIVE_RATE
+    // a faster step's only tried once, in its window
+    uint8_t step = retry == 0 && haveReceiverTime() ? rateStep : 0;
+#if CHANNEL_PLAN
+    // the rendezvous is at the default rate, and clear of the windows
+    if (channelLost) step = 0;
+#endif
+    sleepUntilRateWindow(step);
+    setRate(step);
+#endif
+
     flashLED();
 
     // send the data and wait for an acknowledgement
     rf12_sleep(RF12_WAKEUP);
-    rf12_sendNow(RF12_HDR_ACK, &dataPacket, dataPacket.getTransmitSize());
+    sendDataPacket();
     rf12_sendWait(RADIO_SYNC_MODE);
     acked = waitForAck();
     rf12_sleep(RF12_SLEEP);
 
+#if ADAPTIVE_RATE
+    // back to the default until the receiver says otherwise
+    if (step > 0 && !acked) rateStep = 0;
+    setRate(0);
+#endif
+
     retry++;
   }
   // if hibernating only send once, otherwise keep resending until ack received or retry limit reached
   while (!acked && !hibernating && retry < RETRY_LIMIT);
 
+#if TIME_SYNC
+  if (addedTime) dataPacket.numReadings--;
+#endif
+
+  TRACE_EVENT(TRACE_SHARED, acked);
+
+#if TRACE && !RF69_COMPAT
+  // longest the radio's interrupt took over the tries, which is only measured if
+  // RF12.cpp has ISR_PROFILE, so it's left out of the trace when it's 0
+  uint16_t isrCycles = rf12_isrCycles();
+  if (isrCycles) TRACE_EVENT(TRACE_SHARED, isrCycles);
+#endif
+
+#if CHANNEL_PLAN
+  if (!acked) channelFallBack();
+#endif
+
   if (acked && retry == 1) {
     // succeeded on first try
     successiveRetries = 0;
@@ -251,6 +715,13 @@ inline void doReport(void) {
     transmitPower = findMinTransmitPower();
     successiveRetries = 0;
   }
+
+#if TRACE
+  if (traceRequested) {
+    sendTrace();
+    traceRequested = false;
+  }
+#endif
 }
 
 
@@ -273,13 +744,7 @@ inline void doSleep(void) {
     delayMs = ((uint32_t)myInterval) * 10000;
   }
 
-  #if DEBUG
-    Serial.print(F("hibernating: "));
-    Serial.println(hibernating ? F("true") : F("false"));
-    Serial.print(F("delay(ms): "));
-    Serial.println(delayMs);
-    serialFlush();
-  #endif
+  TRACE_EVENT(TRACE_SHARED, hibernating);
 
   // wait for delayMs milliseconds
   do {
@@ -298,21 +763,11 @@ inline void doSleep(void) {
       delayMs = 0;
     }
 
-    #if DEBUG
-      Serial.print(F("slept for (ms): "));
-      Serial.println(sleepMs);
-      Serial.print(F("new delay(ms): "));
-      Serial.println(delayMs);
-      serialFlush();
-    #endif
+    TRACE_EVENT(TRACE_SHARED, sleepMs);
   }
   // loseSomeTime has minimum resolution of 16ms
-  while (delayMs > 16);
+  while (delayMs > 16 && !consoleRequested);
   
-  #if DEBUG
-    Serial.println(F("finished sleeping"));
-    serialFlush();
-  #endif  
 }
 
 
@@ -334,11 +789,27 @@ inline void readEeprom(void) {
 	portSensor[2] = eeprom_read_byte(EEPROM_PORT3);
 	portSensor[3] = eeprom_read_byte(EEPROM_PORT4);
 	eepromFlags = eeprom_read_byte(EEPROM_FLAGS);
+
+	// an extended node has the RF12 id EXT_RF12_NODE_ID
+	myExtNodeID = eeprom_read_word((uint16_t*) EEPROM_EXT_NODE);
+	if (eeprom_read_byte(EEPROM_NODE) != EXT_RF12_NODE_ID || myExtNodeID <= NODE_MAX || myExtNodeID > EXT_NODE_MAX) {
+		myExtNodeID = 0;
+	}
+	else {
+		myNodeID = EXT_RF12_NODE_ID;
+	}
 	
 	for (uint8_t i=0; i<=3; i++) {
-		if (portSensor[i] < SENSOR_MIN || portSensor[i] > SENSOR_MAX) portSensor[i] = SENSOR_AUTO;
+		// detected sensor types are cached by the 's' command
+		if ((portSensor[i] < SENSOR_MIN || portSensor[i] > SENSOR_MAX) && !Autodetect::isDetectedType(portSensor[i])) {
+			portSensor[i] = SENSOR_AUTO;
+		}
 	}
   #endif
+
+  #if SECURE
+	secureInit();
+  #endif
 }
 
 /////////////////////////////////////////////////////////////////////
@@ -355,12 +826,109 @@ inline void writeEeprom(void) {
 	eeprom_update_byte(EEPROM_PORT3, portSensor[2]);
 	eeprom_update_byte(EEPROM_PORT4, portSensor[3]);
 	eeprom_update_byte(EEPROM_FLAGS, eepromFlags);
+	if (myExtNodeID) eeprom_update_word((uint16_t*) EEPROM_EXT_NODE, myExtNodeID);
   #endif
 }
 
 
 #if !defined(__AVR_ATtiny84__)
 
+/////////////////////////////////////////////////////////////////////
+// Find out what's attached to each port. types is filled in with the sensor type
+// on each port, including configured ones. Ports set to auto or with a cached
+// result are probed and what's found is cached in portSensor[] and EEPROM, so
+// the next probe only has to check the sensor's still there.
+void detectSensors(uint8_t types[4]) {
+	Autodetect ad;
+
+	memcpy(types, portSensor, 4);
+	ad.probePorts(types);
+
+	for (byte p=0; p<4; p++) {
+		if (portSensor[p] == SENSOR_AUTO || Autodetect::isDetectedType(portSensor[p])) {
+			portSensor[p] = Autodetect::isDetectedType(types[p]) ? types[p] : SENSOR_AUTO;
+			eeprom_update_byte(EEPROM_PORT1 + p, portSensor[p]);
+		}
+	}
+}
+
+/////////////////////////////////////////////////////////////////////
+// Warm boot record in EEPROM. It lets a node that's been reset, e.g. by a power cut,
+// skip the start up checks and send its first reading straight away when nothing's
+// changed since the last boot. The DS18B addresses are cached separately (see DS18B).
+struct BootRecord {
+  uint16_t bootCount;
+  uint8_t transmitPower;  // last transmit power that got acks
+  uint8_t portTypes[4];   // sensor type on each port the sensors were built from
+  uint8_t settled;        // set once a reading's been acked since the boot
+  uint8_t crc;
+};
+
+static BootRecord bootRecord;
+
+inline uint8_t bootRecordCRC(void) {
+  const uint8_t* data = (const uint8_t*) &bootRecord;
+  uint8_t crc = 0;
+
+  for (uint8_t i=0; i < sizeof(BootRecord) - 1; i++) {
+    crc = _crc_ibutton_update(crc, data[i]);
+  }
+  return crc;
+}
+
+inline void writeBootRecord(void) {
+  bootRecord.crc = bootRecordCRC();
+  // only changed bytes are written
+  eeprom_update_block(&bootRecord, EEPROM_BOOT_RECORD, sizeof(BootRecord));
+}
+
+/////////////////////////////////////////////////////////////////////
+// Call at the start of setup() with the reset flags from MCUSR. Returns true for a
+// warm boot, where the last boot got as far as an acked reading and the node wasn't
+// reset with its reset pin (the button, or a serial adapter when a terminal is opened).
+// Resetting the node again before its first reading is acked also gives a full start
+// up, for bootloaders that clear the reset flags.
+bool startBoot(uint8_t resetFlags) {
+  eeprom_read_block(&bootRecord, EEPROM_BOOT_RECORD, sizeof(BootRecord));
+
+  bool valid = bootRecord.crc == bootRecordCRC();
+  bool warm = valid && bootRecord.settled && !(resetFlags & _BV(EXTRF));
+
+  if (!valid) memset(&bootRecord, 0, sizeof(BootRecord));
+
+  bootRecord.bootCount++;
+  bootRecord.settled = false;
+  writeBootRecord();
+
+  TRACE_EVENT(TRACE_SHARED, bootRecord.bootCount);
+
+  return warm;
+}
+
+/////////////////////////////////////////////////////////////////////
+// true if the port settings are the same as when the boot record was made
+bool bootPortsMatch(void) {
+  for (byte p=0; p<4; p++) {
+    // a port that's auto with nothing found stays auto
+    if (portSensor[p] != bootRecord.portTypes[p] &&
+        !(portSensor[p] == SENSOR_AUTO && bootRecord.portTypes[p] == SENSOR_NONE)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/////////////////////////////////////////////////////////////////////
+// call after each report. Once a reading's been acked the record is kept for the
+// next boot, along with the transmit power whenever it changes.
+void updateBootRecord(void) {
+  if (lastAckTime == 0) return;
+
+  bootRecord.settled = true;
+  bootRecord.transmitPower = transmitPower;
+  writeBootRecord();
+}
+
 /////////////////////////////////////////////////////////////////////
 inline uint8_t readline(char *buffer, uint8_t bufSize)
 {
@@ -427,12 +995,19 @@ void displaySettings(void) {
 	
 		Serial.print(F(" acknowledgements "));
 		Serial.println( (eepromFlags & FLAG_ACK) ? "on" : "off" );
+
+		Serial.print(F(" periodic statistics "));
+		Serial.println( (eepromFlags & FLAG_STATS) ? "on" : "off" );
   #else
-		Serial.println(myNodeID);
+		Serial.print(nodeID());
+		if (myExtNodeID) Serial.print(F(" (extended)"));
+		Serial.println();
+
+		#if !REPEATER_NODE
 		Serial.print(F(" transmit interval "));
 		Serial.print(myInterval);
 		Serial.println(F("0 seconds"));
-/*
+
 		for (uint8_t port = 0; port <= 3; port++ ) {
 			Serial.print(F(" port "));
 			Serial.print(port + 1);
@@ -451,47 +1026,30 @@ void displaySettings(void) {
 			case SENSOR_PULSE:
 				Serial.println(F("pulse"));
 				break;
+			case SENSOR_PIR:
+				Serial.println(F("PIR (motion sensor)"));
+				break;
+			case SENSOR_ROOM:
+				Serial.println(F("room board LDR and PIR"));
+				break;
 			default:
-				Serial.println(F("[invalid value]"));
-				break;					
+				// a cached autodetect result
+				Serial.print(F("auto, last found "));
+				Serial.println(portSensor[port]);
+				break;
 			}
 		}
-*/
-
-    #if DHT_PORT
-		  Serial.print(F(" DHT11/22 on port "));
-      Serial.println(DHT_PORT);
-    #endif
-
-    #if DS18B_PORT
-      Serial.print(F(" DS18B on port "));
-      Serial.println(DS18B_PORT);
-    #endif
-
-    #if HYT131_PORT
-      Serial.print(F(" HYT131 (room board) on port "));
-      Serial.println(HYT131_PORT);
-    #endif
-
-    #if LDR_PORT
-      Serial.print(F(" LDR (room board) on port "));
-      Serial.println(LDR_PORT);
-    #endif
-
-    #if PIR_PORT
-      Serial.print(F(" PIR (room board) on port "));
-      Serial.println(PIR_PORT);
-    #endif
-
-    #if LCD_PORT
-      Serial.print(F(" LCD display on port "));
-      Serial.println(LCD_PORT);
-    #endif
+		#endif
 
 	#endif
 
   Serial.print(F(" verbose output "));
   Serial.println( (eepromFlags & FLAG_VERBOSE) ? "on" : "off" );
+
+  #if SECURE
+  Serial.print(F(" security key "));
+  Serial.println(secureKeySet ? F("set") : F("not set, packets can't be secured"));
+  #endif
 	
 	Serial.println();
 	Serial.println(F("Commands:"));
@@ -502,19 +1060,28 @@ void displaySettings(void) {
 
 	#if RECEIVER_NODE
 	Serial.println(F(" a<0/1> - turn acks on or off. Valid values: 0 - off, 1 - on"));
+	Serial.println(F(" s<0/1> - turn periodic statistics on or off. Valid values: 0 - off, 1 - on"));
 	#else
-	Serial.println(F(" n<nn> - set node id. Valid values: 2 - 30"));
+	Serial.println(F(" n<nn> - set node id. Valid values: 2 - 30, or 31 - 1023 for extended addressing"));
+	#if !REPEATER_NODE
 	Serial.println(F(" i<nnn> - set interval. Valid values: multiples of 10 from 10 to 2550"));
-//	Serial.println(F(" p<n> <s> - set port n to sensor type s. Valid values: 1-4 for port,"));
-//  Serial.println(F("            sensor: 1 - disabled, 2 - auto, 3 - ldr, 4 - pulse"));
+	Serial.println(F(" p<n> <s> - set port n to sensor type s. Valid values: 1-4 for port,"));
+  Serial.println(F("            sensor: 1 - disabled, 2 - auto, 3 - ldr, 4 - pulse, 7 - pir, 8 - room board ldr and pir"));
   Serial.println(F(" s - test sensors on all ports"));
 //  Serial.println(F(" s - test sensors on all ports and report readings"));
 //	Serial.println(F(" s<n> - test sensor on port n and report reading"));
   Serial.println(F(" r - send a test radio packet"));
   Serial.println(F(" rr - repeatedly test radio (reset JeeNode to exit)"));
+  #if TRACE
+  Serial.println(F(" t - print the event trace"));
+  #endif
+	#endif
 	#endif
 
   Serial.println(F(" v<0/1> - turn verbose output on or off. Valid values: 0 - off, 1 - on"));
+  #if SECURE
+  Serial.println(F(" k<key> - set the security key, 32 hex digits. Written to EEPROM straight away"));
+  #endif
 
 	Serial.println();
 }
@@ -558,6 +1125,32 @@ void parseCommand(char *buffer, uint8_t len) {
       Serial.println( (eepromFlags & FLAG_VERBOSE) ? "on" : "off" );
     }
     break;
+
+  #if SECURE
+  // security key, which the settings don't show
+  case 'k':
+    {
+    uint8_t key[16];
+    bool valid = len == 1 + 2 * sizeof(key);
+
+    for (uint8_t i = 0; valid && i < 2 * sizeof(key); i++) {
+      char c = buffer[1 + i];
+      uint8_t digit = c <= '9' ? c - '0' : (c | 0x20) - 'a' + 10;
+      if (digit > 15) valid = false;
+      key[i / 2] = (i & 1) ? (key[i / 2] << 4) | digit : digit;
+    }
+
+    if (valid) {
+      eeprom_update_block(key, EEPROM_SECURE_KEY, sizeof(key));
+      secureInit();
+      Serial.println(F("Key set"));
+    }
+    else {
+      Serial.println(F("The key must be 32 hex digits"));
+    }
+    break;
+    }
+  #endif
 	
 	#if RECEIVER_NODE
 
@@ -576,17 +1169,39 @@ void parseCommand(char *buffer, uint8_t len) {
 			Serial.println( (eepromFlags & FLAG_ACK) ? "on" : "off" );
 		}
 		break;
+
+	// periodic statistics
+	case 's':
+		if (len > 1) {
+			if (parseInt(&buffer[1], 0, 1) == 1) {
+				eepromFlags |= FLAG_STATS;
+			}
+			else {
+				eepromFlags &= (0xFF - FLAG_STATS);
+			}
+			Serial.print(F("Periodic statistics set to "));
+			Serial.println( (eepromFlags & FLAG_STATS) ? "on" : "off" );
+		}
+		break;
 	#else
 	
 	// node
 	case 'n':
 		if (len > 1) {
-			myNodeID = parseInt(&buffer[1], NODE_MIN, NODE_MAX);
+			{
+			uint16_t id = parseInt(&buffer[1], NODE_MIN, EXT_NODE_MAX);
+
+			// ids too big for the RF12 header use extended addressing
+			myExtNodeID = id > NODE_MAX ? id : 0;
+			myNodeID = id > NODE_MAX ? EXT_RF12_NODE_ID : id;
+			}
 			Serial.print(F("Node id set to "));
-			Serial.println(myNodeID);
+			Serial.println(nodeID());
 		}
 		break;
 
+	#if !REPEATER_NODE
+
 	// interval
 	case 'i':
 		if (len > 1) {
@@ -601,6 +1216,13 @@ void parseCommand(char *buffer, uint8_t len) {
 		if (len == 4) {
 			uint8_t port = parseInt(&buffer[1], 1, 4) - 1;
 			uint8_t sensorType = parseInt(&buffer[3], SENSOR_MIN, SENSOR_MAX);
+
+			// detected types can't be set by hand
+			if (Autodetect::isDetectedType(sensorType)) {
+				Serial.println(F("Invalid sensor type"));
+				break;
+			}
+
 			portSensor[port] = sensorType;
 			Serial.print(F("Port "));
 			Serial.print(port + 1);
@@ -618,6 +1240,12 @@ void parseCommand(char *buffer, uint8_t len) {
 			case SENSOR_PULSE:
 				Serial.println(F("pulse"));
 				break;
+			case SENSOR_PIR:
+				Serial.println(F("PIR"));
+				break;
+			case SENSOR_ROOM:
+				Serial.println(F("room board LDR and PIR"));
+				break;
 			}
 		}
 		break;
@@ -625,13 +1253,18 @@ void parseCommand(char *buffer, uint8_t len) {
 	// test sensors
 	case 's':
 		{
-		Autodetect ad;
+		Serial.println(F("Probing ports..."));
+		serialFlush();
+
+		uint8_t types[4];
+		detectSensors(types);
+
 		for (byte p=1; p<=4; p++) {
 			Serial.print(F("Port "));
 			Serial.print(p);
 			Serial.print(F(": "));
-			serialFlush();
-			switch(ad.probePort(p)) {
+
+			switch(types[p-1]) {
 				case SENSOR_DHT11:
 					Serial.println(F("DHT11"));
 					break;
@@ -644,6 +1277,9 @@ void parseCommand(char *buffer, uint8_t len) {
 				case SENSOR_HYT131:
 					Serial.println(F("HYT131"));
 					break;
+				case SENSOR_BMP085:
+					Serial.println(F("BMP085"));
+					break;
 				case SENSOR_LCD:
 					Serial.println(F("LCD"));
 					break;
@@ -653,6 +1289,18 @@ void parseCommand(char *buffer, uint8_t len) {
 				case SENSOR_I2C_UNKNOWN:
 					Serial.println(F("Unknown I2C"));
 					break;
+				case SENSOR_LDR:
+					Serial.println(F("LDR (configured)"));
+					break;
+				case SENSOR_PULSE:
+					Serial.println(F("pulse (configured)"));
+					break;
+				case SENSOR_PIR:
+					Serial.println(F("PIR (configured)"));
+					break;
+				case SENSOR_ROOM:
+					Serial.println(F("room board LDR and PIR (configured)"));
+					break;
 				default:
 					Serial.println(F("None"));
 			}
@@ -684,13 +1332,69 @@ void parseCommand(char *buffer, uint8_t len) {
     break;
     }
 
+	#if TRACE
+	case 't':
+	  {
+	  TraceEvent events[TRACE_EVENTS_PER_PACKET];
+	  uint8_t first = 0;
+	  uint8_t n;
+
+	  while ((n = traceCopy(events, first, TRACE_EVENTS_PER_PACKET)) > 0) {
+	    tracePrint(nodeID(), events, n);
+	    first += n;
+	  }
+	  serialFlush();
+
+	  break;
+	  }
+	#endif
+
+	#endif
+
 	#endif
 	}
 }
 
 /////////////////////////////////////////////////////////////////////
-// config console for standard Jeenodes
-void configConsole(void) {
+// true if something's holding the serial RX line high, as a connected serial adapter
+// does when it's idle. A line that's low isn't held, and isn't touched. One that's high
+// may only be floating, so it's pulled low for a few clock cycles and let go, and only
+// a held line goes high again. Telling them apart needs the line to be pulled
+// against whatever's holding it, but that's kept to a quarter of a microsecond once
+// per boot. The serial port must be off.
+bool serialHostPresent(void) {
+	pinMode(CONSOLE_RX_PIN, INPUT);
+	delayMicroseconds(10);
+	if (!digitalRead(CONSOLE_RX_PIN)) return false;
+
+	volatile uint8_t* ddr = portModeRegister(digitalPinToPort(CONSOLE_RX_PIN));
+	uint8_t mask = digitalPinToBitMask(CONSOLE_RX_PIN);
+
+	// the pin's PORT bit is already clear from INPUT, so setting DDR drives it low
+	uint8_t oldSREG = SREG;
+	cli();
+	*ddr |= mask;
+	*ddr &= ~mask;
+	SREG = oldSREG;
+
+	delayMicroseconds(10);
+	return digitalRead(CONSOLE_RX_PIN);
+}
+
+/////////////////////////////////////////////////////////////////////
+// config console for standard Jeenodes. hostPresent is true if there's known to be
+// something connected to the serial port, e.g. a key press has just come from it.
+void configConsole(bool hostPresent = false) {
+
+	// don't wait for a key press if nothing's connected to the serial port
+	if (!hostPresent) {
+		serialFlush();
+		Serial.end();
+		hostPresent = serialHostPresent();
+		Serial.begin(BAUD_RATE);
+	}
+
+	if (!hostPresent) return;
 
 	// wait and see if user wants to enter config
 	Serial.println();
@@ -700,7 +1404,7 @@ void configConsole(void) {
 	uint32_t start = millis();
 	bool enterConfig = false;
 	
-	for (uint8_t secs=5; secs > 0; secs--) {
+	for (uint8_t secs=CONSOLE_WAIT_SECS; secs > 0; secs--) {
 		Serial.print(F("\r"));
 		Serial.print(secs);
     serialFlush();
@@ -724,7 +1428,7 @@ void configConsole(void) {
 		
 		displaySettings();
 
-		char buffer[10];
+		char buffer[CONSOLE_BUFFER_SIZE];
 		uint8_t len;
 		
 		while (buffer[0] != 'x') {
@@ -733,7 +1437,7 @@ void configConsole(void) {
 
 			// wait for a command
 			do {
-				len = readline(buffer, 10);
+				len = readline(buffer, CONSOLE_BUFFER_SIZE);
 			} while (len == 0);
 			Serial.println();
 			
@@ -746,6 +1450,44 @@ void configConsole(void) {
   serialFlush();
   flashLED(2);
 }
+
+#if CONSOLE_WAKE && !RECEIVER_NODE
+/////////////////////////////////////////////////////////////////////
+static void serialRxChanged(uint8_t pins, uint8_t changed) {
+	consoleRequested = true;
+}
+
+/////////////////////////////////////////////////////////////////////
+// call once the node's set up. A key press on the serial port then wakes the node and
+// sets consoleRequested. The pull-up keeps the line high if nothing's connected.
+void enableConsoleWake(void) {
+	pinMode(CONSOLE_RX_PIN, INPUT_PULLUP);
+	PinChange::attach(CONSOLE_RX_PIN, serialRxChanged);
+}
+
+/////////////////////////////////////////////////////////////////////
+// run the config console if a key press has woken the node. Call at the start of loop().
+// Changes to the ports only take effect after a reset.
+void checkConsoleWake(void) {
+	if (!consoleRequested) return;
+
+	PinChange::detach(CONSOLE_RX_PIN);
+	Serial.begin(BAUD_RATE);
+	configConsole(true);
+
+	// pick up any change of group or node id
+	rf12_initialize(myNodeID, RF12_868MHZ, myGroupID);
+	rf12_sleep(RF12_SLEEP);
+
+	#if !DEBUG
+		if (!(eepromFlags & FLAG_VERBOSE)) Serial.end();
+	#endif
+
+	consoleRequested = false;
+	enableConsoleWake();
+}
+#endif
+
 #endif
 
 #endif
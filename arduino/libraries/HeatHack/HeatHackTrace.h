@@ -0,0 +1,140 @@
+#ifndef HEATHACK_TRACE_H
+#define HEATHACK_TRACE_H
+
+#include <Arduino.h>
+
+/*
+ * Event trace for finding out what the node's doing without changing its timing
+ * the way printing to the serial port does.
+ *
+ * TRACE_EVENT(file, value) records the source file and line it's on, a 16 bit
+ * value and the low 16 bits of millis() in a ring buffer in RAM, which takes a few
+ * microseconds. The ring holds the last TRACE_SIZE events.
+ *
+ * The ring isn't cleared by a reset, so after a node's been reset the events
+ * leading up to it are still there. It's printed by the config console's t command,
+ * or sent over the radio after the receiver's asked for it (type t<node> into the
+ * receiver's serial port). Both print lines starting "trace", which
+ * raspberrypi/heathackhub/trace-decode.js turns back into file names and line
+ * numbers.
+ *
+ * Tracing is off unless the sketch defines TRACE as true before including the
+ * HeatHack headers, and then TRACE_EVENT compiles to nothing.
+ */
+#ifndef TRACE
+	#define TRACE false
+#endif
+
+// number of events kept, must be a power of 2
+#ifndef TRACE_SIZE
+	#if defined(__AVR_ATtiny84__)
+		#define TRACE_SIZE 8
+	#else
+		#define TRACE_SIZE 32
+	#endif
+#endif
+
+// files that record events. trace-decode.js has the same list.
+#define TRACE_SKETCH 0
+#define TRACE_SHARED 1
+#define TRACE_SENSORS 2
+#define TRACE_ROOMBOARD 3
+
+// marks the ring as valid after a reset
+#define TRACE_MAGIC 0x7EC5
+
+// sent as the ack's data to ask a node for its trace
+#define ACK_TRACE_REQUEST 'T'
+
+// max events in each radio packet, after its HHExtHeader
+#define TRACE_EVENTS_PER_PACKET 10
+
+// time between trace packets, for the receiver to print each one
+#define TRACE_PACKET_GAP_MS 250
+
+struct TraceEvent {
+	uint16_t id;      // file in the top 4 bits, line in the rest
+	uint16_t value;
+	uint16_t time;    // low 16 bits of millis()
+};
+
+#if TRACE
+
+#define TRACE_EVENT(file, value) traceEvent(((uint16_t) (file) << 12) | (__LINE__ & 0x0FFF), (value))
+
+static struct {
+	uint16_t magic;
+	uint8_t next;     // where the next event goes
+	uint8_t count;    // number of events in the ring
+	TraceEvent events[TRACE_SIZE];
+} traceRing __attribute__((section(".noinit")));
+
+// call at start up. Keeps the events from before a reset if they're intact.
+static void traceInit(void) {
+	if (traceRing.magic != TRACE_MAGIC || traceRing.next >= TRACE_SIZE || traceRing.count > TRACE_SIZE) {
+		traceRing.magic = TRACE_MAGIC;
+		traceRing.next = 0;
+		traceRing.count = 0;
+	}
+}
+
+static void traceEvent(uint16_t id, uint16_t value) {
+	uint16_t time = millis();
+	uint8_t oldSREG = SREG;
+	cli();
+
+	TraceEvent& event = traceRing.events[traceRing.next];
+	event.id = id;
+	event.value = value;
+	event.time = time;
+
+	traceRing.next = (traceRing.next + 1) & (TRACE_SIZE - 1);
+	if (traceRing.count < TRACE_SIZE) traceRing.count++;
+
+	SREG = oldSREG;
+}
+
+// copy up to max events, oldest first, starting from the first'th oldest.
+// Returns the number copied.
+static uint8_t traceCopy(TraceEvent* events, uint8_t first, uint8_t max) {
+	uint8_t oldSREG = SREG;
+	cli();
+
+	uint8_t oldest = (traceRing.next - traceRing.count) & (TRACE_SIZE - 1);
+	uint8_t n = 0;
+
+	while (first + n < traceRing.count && n < max) {
+		events[n] = traceRing.events[(oldest + first + n) & (TRACE_SIZE - 1)];
+		n++;
+	}
+
+	SREG = oldSREG;
+	return n;
+}
+
+#else
+
+#define TRACE_EVENT(file, value)
+
+static inline void traceInit(void) {}
+
+#endif
+
+// print the events as they're sent by the receiver: trace <node> <id>:<value>:<time> ...
+// It's inline as the receiver uses it without TRACE, which nodes don't.
+static inline void tracePrint(uint16_t node, const TraceEvent* events, uint8_t n) {
+	Serial.print(F("trace "));
+	Serial.print(node);
+
+	for (uint8_t i = 0; i < n; i++) {
+		Serial.print(' ');
+		Serial.print(events[i].id, HEX);
+		Serial.print(':');
+		Serial.print(events[i].value, HEX);
+		Serial.print(':');
+		Serial.print(events[i].time, HEX);
+	}
+	Serial.println();
+}
+
+#endif
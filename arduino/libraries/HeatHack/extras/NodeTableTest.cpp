@@ -0,0 +1,142 @@
+/*
+ * Stress test of the receiver's node table (HeatHackNodeTable.h) with hundreds of
+ * simulated nodes, at the size the receiver is built with. It runs on a PC:
+ *
+ *   g++ -Wall -I.. -o NodeTableTest NodeTableTest.cpp && ./NodeTableTest
+ *
+ * and again with -DSECURE=1 for the smaller table of a SECURE receiver. It prints
+ * what it found and exits with 1 if any check failed.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include "HeatHackNodeTable.h"
+
+#define EXT_RF12_NODE_ID 31
+#define EXT_NODE_MAX 1023
+
+// how many packets each node sends on average, and the chance in 100 that a packet
+// is received again, as when the node doesn't get the ack or a repeater passes it on
+#define ROUNDS 50
+#define RESEND_PERCENT 20
+
+static int failures = 0;
+
+static void check(bool ok, const char* what) {
+	printf("%s %s\n", ok ? "ok  " : "FAIL", what);
+	if (!ok) failures++;
+}
+
+static void clearTable(void) {
+	memset(nodeTable, 0, sizeof(nodeTable));
+	nodeEvictions = 0;
+}
+
+// n different extended ids in a random order
+static void randomIds(uint16_t* ids, int n) {
+	static bool used[EXT_NODE_MAX + 1];
+	memset(used, 0, sizeof(used));
+
+	for (int i = 0; i < n; i++) {
+		uint16_t id;
+		do id = EXT_RF12_NODE_ID + rand() % (EXT_NODE_MAX - EXT_RF12_NODE_ID + 1); while (used[id]);
+		used[id] = true;
+		ids[i] = id;
+	}
+}
+
+// the slots searched to find the node
+static int probes(uint16_t id) {
+	uint8_t slot;
+	lookupNode(id, slot);
+	return ((slot - nodeHome(id)) & (NODE_TABLE_SIZE - 1)) + 1;
+}
+
+// true if the receiver reports the packet, which it does unless its sequence number
+// is the same as the last one from the node, as in handleData
+static bool receive(uint16_t id, uint8_t sequence) {
+	NodeEntry* entry = &nodeTable[findNode(id)];
+	if (entry->lastSequence == sequence) return false;
+
+	entry->lastSequence = sequence;
+	return true;
+}
+
+// ROUNDS packets per node, each from a node picked at random. Some of them are received again
+// after the next node's packet, as when a repeater passes one on. Returns the resent
+// packets that were reported a second time.
+static int simulateTraffic(const uint16_t* ids, int n) {
+	uint8_t* sequence = (uint8_t*) calloc(n, 1);
+	int resent = -1;
+	int twice = 0;
+
+	for (int round = 0; round < ROUNDS; round++) {
+		for (int i = 0; i < n; i++) {
+			int node = rand() % n;
+			sequence[node] = (sequence[node] + 1) & 7;
+			receive(ids[node], sequence[node]);
+
+			if (resent >= 0 && resent != node && receive(ids[resent], sequence[resent])) twice++;
+			resent = rand() % 100 < RESEND_PERCENT ? node : -1;
+		}
+	}
+
+	free(sequence);
+	return twice;
+}
+
+int main(void) {
+	static uint16_t ids[NODE_TABLE_SIZE + 64];
+	char what[100];
+	srand(1);
+
+	printf("node table of %d slots, %d bytes on this computer\n", NODE_TABLE_SIZE, (int) sizeof(nodeTable));
+
+	// a full table of random extended ids
+	clearTable();
+	randomIds(ids, NODE_TABLE_SIZE);
+	int worst = 0;
+	long total = 0;
+	bool found = true;
+	for (int i = 0; i < NODE_TABLE_SIZE; i++) findNode(ids[i]);
+	for (int i = 0; i < NODE_TABLE_SIZE; i++) {
+		uint8_t slot;
+		if (!lookupNode(ids[i], slot) || nodeTable[slot].id != ids[i]) found = false;
+		int n = probes(ids[i]);
+		total += n;
+		if (n > worst) worst = n;
+	}
+	snprintf(what, sizeof(what), "%d random nodes fill the table without evictions", NODE_TABLE_SIZE);
+	check(nodeEvictions == 0 && found, what);
+	printf("     slots searched per lookup: mean %.1f, worst %d\n", (double) total / NODE_TABLE_SIZE, worst);
+
+	// nodes numbered in order, as a building usually is
+	clearTable();
+	for (int i = 0; i < NODE_TABLE_SIZE; i++) ids[i] = 2 + i;
+	for (int i = 0; i < NODE_TABLE_SIZE; i++) findNode(ids[i]);
+	worst = 0;
+	for (int i = 0; i < NODE_TABLE_SIZE; i++) {
+		if (probes(ids[i]) > worst) worst = probes(ids[i]);
+	}
+	snprintf(what, sizeof(what), "%d consecutive nodes fill the table without evictions", NODE_TABLE_SIZE);
+	check(nodeEvictions == 0, what);
+	printf("     slots searched per lookup: worst %d\n", worst);
+
+	// traffic from hundreds of nodes, or as many as fit
+	int n = NODE_TABLE_SIZE < 200 ? NODE_TABLE_SIZE : 200;
+	clearTable();
+	randomIds(ids, n);
+	int twice = simulateTraffic(ids, n);
+	snprintf(what, sizeof(what), "%d nodes sending %d packets each on average, with resends, are each reported once", n, ROUNDS);
+	check(twice == 0 && nodeEvictions == 0, what);
+
+	// more nodes than the table holds, which it should survive
+	n = NODE_TABLE_SIZE + 64;
+	clearTable();
+	randomIds(ids, n);
+	twice = simulateTraffic(ids, n);
+	snprintf(what, sizeof(what), "%d nodes in %d slots take over others' slots", n, NODE_TABLE_SIZE);
+	check(nodeEvictions > 0, what);
+	printf("     evictions %d, resent packets reported twice %d\n", nodeEvictions, twice);
+
+	return failures ? 1 : 0;
+}
@@ -339,7 +339,7 @@ void OneWire::target_search(uint8_t family_code)
 // Return TRUE  : device found, ROM number in ROM_NO buffer
 //        FALSE : device not found, end of search
 //
-uint8_t OneWire::search(uint8_t *newAddr)
+uint8_t OneWire::search(uint8_t *newAddr, bool search_mode)
 {
    uint8_t id_bit_number;
    uint8_t last_zero, rom_byte_number, search_result;
@@ -367,8 +367,13 @@ uint8_t OneWire::search(uint8_t *newAddr)
          return FALSE;
       }
 
-      // issue the search command
-      write(0xF0);
+      // issue the search command, normal or conditional (alarm) search
+      if (search_mode) {
+         write(0xF0);
+      }
+      else {
+         write(0xEC);
+      }
 
       // loop to do the search
       do
@@ -0,0 +1,98 @@
+// Shared pin-change interrupt dispatcher, see PinChange.h
+
+#include "PinChange.h"
+#include <avr/interrupt.h>
+
+// per-bank registers: input port, mask register and enable bit.
+// The bit for each pin in a bank's mask register matches its bit in the port.
+#if defined(__AVR_ATtiny84__) || defined(__AVR_ATtiny44__)
+#define BANK0_PIN   PINA
+#define BANK1_PIN   PINB
+#define BANK_PCICR  GIMSK
+#define FIRST_PORT  PA      // port A is bank 0
+static volatile uint8_t* const pcmsk[] = { &PCMSK0, &PCMSK1 };
+#else
+#define BANK0_PIN   PINB
+#define BANK1_PIN   PINC
+#define BANK2_PIN   PIND
+#define BANK_PCICR  PCICR
+#define FIRST_PORT  PB      // port B is bank 0
+static volatile uint8_t* const pcmsk[] = { &PCMSK0, &PCMSK1, &PCMSK2 };
+#endif
+
+PinChange::Bank PinChange::banks[PINCHANGE_BANKS];
+
+bool PinChange::lookup(uint8_t pin, uint8_t& bank, uint8_t& mask) {
+    bank = digitalPinToPort(pin) - FIRST_PORT;
+    mask = digitalPinToBitMask(pin);
+    return bank < PINCHANGE_BANKS;
+}
+
+static volatile uint8_t* bankInput (uint8_t bank) {
+    return portInputRegister(bank + FIRST_PORT);
+}
+
+bool PinChange::attach(uint8_t pin, PinChangeHandler handler) {
+    uint8_t bank, mask;
+    if (!lookup(pin, bank, mask))
+        return false;
+
+    Bank& b = banks[bank];
+    bool ok = true;
+
+    uint8_t oldSREG = SREG;
+    cli();
+
+    uint8_t i = 0;
+    while (i < b.count && b.mask[i] != mask)
+        ++i;
+
+    if (i < PINCHANGE_MAX_HANDLERS) {
+        b.mask[i] = mask;
+        b.handler[i] = handler;
+        if (i == b.count)
+            ++b.count;
+
+        // only changes from now on are of interest
+        b.last = (b.last & ~mask) | (*bankInput(bank) & mask);
+
+        *pcmsk[bank] |= mask;
+        BANK_PCICR |= _BV(PCIE0 + bank);
+    } else
+        ok = false;
+
+    SREG = oldSREG;
+    return ok;
+}
+
+void PinChange::detach(uint8_t pin) {
+    uint8_t bank, mask;
+    if (!lookup(pin, bank, mask))
+        return;
+
+    Bank& b = banks[bank];
+
+    uint8_t oldSREG = SREG;
+    cli();
+
+    *pcmsk[bank] &= ~mask;
+    if (*pcmsk[bank] == 0)
+        BANK_PCICR &= ~_BV(PCIE0 + bank);
+
+    for (uint8_t i = 0; i < b.count; ++i)
+        if (b.mask[i] == mask) {
+            // keep the table packed so the interrupt only scans used slots
+            --b.count;
+            b.mask[i] = b.mask[b.count];
+            b.handler[i] = b.handler[b.count];
+            break;
+        }
+
+    SREG = oldSREG;
+}
+
+ISR(PCINT0_vect) { PinChange::dispatch(0, BANK0_PIN); }
+ISR(PCINT1_vect) { PinChange::dispatch(1, BANK1_PIN); }
+#if PINCHANGE_BANKS > 2
+ISR(PCINT2_vect) { PinChange::dispatch(2, BANK2_PIN); }
+#endif
@@ -0,0 +1,75 @@
+#ifndef PinChange_h
+#define PinChange_h
+
+/// @file
+/// Shared pin-change interrupt dispatcher.
+///
+/// Each pin-change interrupt vector covers a whole bank of pins, so only one
+/// piece of code can define it. This library owns the vectors and passes each
+/// change on to the handlers registered for the pins that changed, so several
+/// interrupt-driven sensors (and the RF12 driver with PINCHG_IRQ) can share a
+/// bank.
+///
+/// Sketches using it must include <PinChange.h> so the Arduino IDE picks up
+/// the library, and must not define any PCINTn_vect handlers themselves.
+
+#if ARDUINO >= 100
+#include <Arduino.h> // Arduino 1.0
+#else
+#include <WProgram.h> // Arduino 0022
+#endif
+#include <stdint.h>
+
+/// max number of handlers that can be registered on each bank
+#ifndef PINCHANGE_MAX_HANDLERS
+#define PINCHANGE_MAX_HANDLERS 3
+#endif
+
+#if defined(__AVR_ATtiny84__) || defined(__AVR_ATtiny44__)
+#define PINCHANGE_BANKS 2
+#else
+#define PINCHANGE_BANKS 3
+#endif
+
+/// Handler called from the interrupt with the current state of all the pins
+/// in the bank and a mask of those that have changed. Each bit corresponds to
+/// the pin's bit in its port. Keep it short, interrupts are disabled.
+typedef void (*PinChangeHandler)(uint8_t pins, uint8_t changed);
+
+/// Dispatches pin-change interrupts to registered handlers.
+class PinChange {
+public:
+    /// Register a handler for changes on an Arduino digital pin and enable
+    /// its interrupt. A pin can only have one handler.
+    /// @returns false if the bank has no free handler slots.
+    static bool attach(uint8_t pin, PinChangeHandler handler);
+
+    /// Remove the pin's handler and disable its interrupt. The bank's
+    /// interrupt is turned off once no pins in it are in use.
+    static void detach(uint8_t pin);
+
+    /// Called from the interrupt vectors with a fresh read of the bank's pins.
+    static inline void dispatch(uint8_t bank, uint8_t pins) {
+        Bank& b = banks[bank];
+        uint8_t changed = pins ^ b.last;
+        b.last = pins;
+
+        for (uint8_t i = 0; i < b.count; ++i)
+            if (changed & b.mask[i])
+                b.handler[i](pins, changed);
+    }
+
+private:
+    struct Bank {
+        uint8_t last;   // pin state at the last interrupt
+        uint8_t count;  // handlers in use
+        uint8_t mask[PINCHANGE_MAX_HANDLERS];
+        PinChangeHandler handler[PINCHANGE_MAX_HANDLERS];
+    };
+
+    static Bank banks[PINCHANGE_BANKS];
+
+    static bool lookup(uint8_t pin, uint8_t& bank, uint8_t& mask);
+};
+
+#endif
@@ -8,6 +8,13 @@
 // line "#define RF69_COMPAT 1" before including this <JeeLib.h> header file.
 // Define it as 0 otherwise, to support "if (RF69_COMPAT) ..." in app code.
 
+// RF69_NATIVE (see RF69_compat.h) implies RF69_COMPAT.
+
+#if (RF69_NATIVE || RF69_NATIVE_FAST) && !RF69_COMPAT
+#undef RF69_COMPAT
+#define RF69_COMPAT 1
+#endif
+
 #if RF69_COMPAT
 #include <RF69_compat.h>
 #elif !defined(RF69_COMPAT)
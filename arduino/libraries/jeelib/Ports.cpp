@@ -955,9 +955,7 @@ long AnalogPlug::reading () {
 }
 
 void HYT131::reading (int& temp, int& humi, byte (*delayFun)(word ms)) {
-    // Start measurement
-    send();
-    stop();
+    request();
     
     // Wait for completion (using user-supplied (low-power?) delay function)
     if (delayFun)
@@ -965,9 +963,28 @@ void HYT131::reading (int& temp, int& humi, byte (*delayFun)(word ms)) {
     else
         delay(100);
     
-    // Extract readings
+    fetch(temp, humi);
+}
+
+void HYT131::request () {
+    // Start measurement
+    send();
+    stop();
+}
+
+bool HYT131::fetch (int& temp, int& humi) {
     receive();
-    uint16_t h = (read(0) & 0x3F) << 8;
+    byte status = read(0);
+    
+    // stale bit is set until the measurement has finished. read(1) ends the
+    // transfer with a stop condition.
+    if (status & 0x40) {
+        read(1);
+        return false;
+    }
+    
+    // Extract readings
+    uint16_t h = (status & 0x3F) << 8;
     h |= read(0);
     uint16_t t = read(0) << 6;
     t |= read(1) >> 2;
@@ -976,6 +993,7 @@ void HYT131::reading (int& temp, int& humi, byte (*delayFun)(word ms)) {
     humi = (h * 1000L >> 14);
     // convert 0..16383 to -40 .. 125 (*10)
     temp = (t * 1650L >> 14) - 400;
+    return true;
 }
 
 DHTxx::DHTxx (byte pinNum) : pin (pinNum) {
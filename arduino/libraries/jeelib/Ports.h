@@ -531,6 +531,15 @@ public:
     // @param humi in which to store the humidity (int, tenths of percent)
     // @param delayFun (optional) supply delayFun that takes ms delay as argument, for low-power waiting during reading (e.g. Sleepy::loseSomeTime()). By default, delay() is used
     void reading (int& temp, int& humi, byte (*delayFun)(word ms) =0);
+
+    /// Start a measurement without waiting for it. Collect the result with fetch().
+    void request ();
+    /// Collect the result of a measurement started with request(). The conversion
+    /// takes up to 100ms but is often quicker, so this can be polled.
+    /// @param temp in which to store the temperature (int, tenths of degrees C)
+    /// @param humi in which to store the humidity (int, tenths of percent)
+    /// @returns false if the measurement hasn't finished yet (the stale bit is set)
+    bool fetch (int& temp, int& humi);
 };
 
 /// Interface for the Gravity Plug - see http://jeelabs.org/gp
@@ -4,6 +4,9 @@
 /// Port library interface to BMP085 sensors connected via I2C.
 /// See http://jeelabs.net/projects/hardware/wiki/pp1
 
+#ifndef PortsBMP085_h
+#define PortsBMP085_h
+
 /// Interface for the Pressure Plug - see http://jeelabs.org/pp
 class BMP085 : public DeviceI2C {
     int16_t ac1, ac2, ac3, b1, b2, mb, mc, md;
@@ -44,3 +47,5 @@ public:
     void getCalibData();
     void calculate(int16_t& tval, int32_t& pval) const;
 };
+
+#endif
@@ -13,10 +13,21 @@
 #include <WProgram.h> // Arduino 0022
 #endif
 
-// #define OPTIMIZE_SPI 1  // uncomment this to write to the RFM12B @ 8 Mhz
+#define OPTIMIZE_SPI 1     // comment this out to write to the RFM12B @ 2 MHz
+
+// #define CRC_TABLE 1     // uncomment this to use a 512 byte table for the crc,
+                           // which takes 8 fewer cycles per byte in the interrupt
+
+// #define ISR_PROFILE 1   // uncomment this to record the longest time spent in
+                           // the interrupt, see rf12_isrCycles()
 
 // pin change interrupts are currently only supported on ATmega328's
 // #define PINCHG_IRQ 1    // uncomment this to use pin-change interrupts
+                           // (needs the PinChange library, include <PinChange.h> in the sketch)
+
+#if PINCHG_IRQ
+#include <PinChange.h>
+#endif
 
 // maximum transmit / receive buffer: 3 header + data + 2 crc bytes
 #define RF_MAX   (RF12_MAXDATA + 5)
@@ -168,10 +179,8 @@ void rf12_spiInit () {
     pinMode(SPI_SCK, OUTPUT);
 #ifdef SPCR    
     SPCR = _BV(SPE) | _BV(MSTR);
-#if F_CPU > 10000000
-    // use clk/2 (2x 1/4th) for sending (and clk/8 for recv, see rf12_xferSlow)
+    // use clk/2 (2x 1/4th) for sending (and slower for recv, see rf12_xferSlow)
     SPSR |= _BV(SPI2X);
-#endif
 #else
     // ATtiny
     USICR = bit(USIWM0);
@@ -180,6 +189,21 @@ void rf12_spiInit () {
     digitalWrite(RFM_IRQ, 1); // pull-up
 }
 
+// The RFM12B can be written at up to 20 MHz, but its receive FIFO can only be
+// read at under 2.5 MHz. SPI_FAST is used for everything else, and is clk/2.
+#ifdef SPCR
+#if F_CPU > 10000000
+#define SPI_SLOW()  bitSet(SPCR, SPR0)      // clk/8
+#define SPI_FAST()  bitClear(SPCR, SPR0)
+#else
+#define SPI_SLOW()  bitClear(SPSR, SPI2X)   // clk/4
+#define SPI_FAST()  bitSet(SPSR, SPI2X)
+#endif
+#else
+#define SPI_SLOW()  // ATtiny, the USI code below stays under 2.5 MHz
+#define SPI_FAST()
+#endif
+
 static uint8_t rf12_byte (uint8_t out) {
 #ifdef SPDR
     SPDR = out;
@@ -214,16 +238,12 @@ static uint8_t rf12_byte (uint8_t out) {
 
 static uint16_t rf12_xferSlow (uint16_t cmd) {
     // slow down to under 2.5 MHz
-#if F_CPU > 10000000
-    bitSet(SPCR, SPR0);
-#endif
+    SPI_SLOW();
     bitClear(SS_PORT, cs_pin);
     uint16_t reply = rf12_byte(cmd >> 8) << 8;
     reply |= rf12_byte(cmd);
     bitSet(SS_PORT, cs_pin);
-#if F_CPU > 10000000
-    bitClear(SPCR, SPR0);
-#endif
+    SPI_FAST();
     return reply;
 }
 
@@ -231,7 +251,7 @@ static uint16_t rf12_xferSlow (uint16_t cmd) {
 static void rf12_xfer (uint16_t cmd) {
     // writing can take place at full speed, even 8 MHz works
     bitClear(SS_PORT, cs_pin);
-    rf12_byte(cmd >> 8) << 8;
+    rf12_byte(cmd >> 8);
     rf12_byte(cmd);
     bitSet(SS_PORT, cs_pin);
 }
@@ -239,6 +259,69 @@ static void rf12_xfer (uint16_t cmd) {
 #define rf12_xfer rf12_xferSlow
 #endif
 
+// Reads the status, which clears the interrupt, and carries on clocking to get
+// the FIFO byte that follows it, all in one transfer. Only the FIFO byte has to
+// be read slowly.
+static uint8_t rf12_statusFifo () {
+#if !OPTIMIZE_SPI
+    SPI_SLOW();
+#endif
+    bitClear(SS_PORT, cs_pin);
+    rf12_byte(0x00);
+    rf12_byte(0x00);
+#if OPTIMIZE_SPI
+    SPI_SLOW();
+#endif
+    uint8_t in = rf12_byte(0x00);
+    bitSet(SS_PORT, cs_pin);
+    SPI_FAST();
+    return in;
+}
+
+#if CRC_TABLE
+static const uint16_t crcTable[256] PROGMEM = {
+    0x0000, 0xC0C1, 0xC181, 0x0140, 0xC301, 0x03C0, 0x0280, 0xC241,
+    0xC601, 0x06C0, 0x0780, 0xC741, 0x0500, 0xC5C1, 0xC481, 0x0440,
+    0xCC01, 0x0CC0, 0x0D80, 0xCD41, 0x0F00, 0xCFC1, 0xCE81, 0x0E40,
+    0x0A00, 0xCAC1, 0xCB81, 0x0B40, 0xC901, 0x09C0, 0x0880, 0xC841,
+    0xD801, 0x18C0, 0x1980, 0xD941, 0x1B00, 0xDBC1, 0xDA81, 0x1A40,
+    0x1E00, 0xDEC1, 0xDF81, 0x1F40, 0xDD01, 0x1DC0, 0x1C80, 0xDC41,
+    0x1400, 0xD4C1, 0xD581, 0x1540, 0xD701, 0x17C0, 0x1680, 0xD641,
+    0xD201, 0x12C0, 0x1380, 0xD341, 0x1100, 0xD1C1, 0xD081, 0x1040,
+    0xF001, 0x30C0, 0x3180, 0xF141, 0x3300, 0xF3C1, 0xF281, 0x3240,
+    0x3600, 0xF6C1, 0xF781, 0x3740, 0xF501, 0x35C0, 0x3480, 0xF441,
+    0x3C00, 0xFCC1, 0xFD81, 0x3D40, 0xFF01, 0x3FC0, 0x3E80, 0xFE41,
+    0xFA01, 0x3AC0, 0x3B80, 0xFB41, 0x3900, 0xF9C1, 0xF881, 0x3840,
+    0x2800, 0xE8C1, 0xE981, 0x2940, 0xEB01, 0x2BC0, 0x2A80, 0xEA41,
+    0xEE01, 0x2EC0, 0x2F80, 0xEF41, 0x2D00, 0xEDC1, 0xEC81, 0x2C40,
+    0xE401, 0x24C0, 0x2580, 0xE541, 0x2700, 0xE7C1, 0xE681, 0x2640,
+    0x2200, 0xE2C1, 0xE381, 0x2340, 0xE101, 0x21C0, 0x2080, 0xE041,
+    0xA001, 0x60C0, 0x6180, 0xA141, 0x6300, 0xA3C1, 0xA281, 0x6240,
+    0x6600, 0xA6C1, 0xA781, 0x6740, 0xA501, 0x65C0, 0x6480, 0xA441,
+    0x6C00, 0xACC1, 0xAD81, 0x6D40, 0xAF01, 0x6FC0, 0x6E80, 0xAE41,
+    0xAA01, 0x6AC0, 0x6B80, 0xAB41, 0x6900, 0xA9C1, 0xA881, 0x6840,
+    0x7800, 0xB8C1, 0xB981, 0x7940, 0xBB01, 0x7BC0, 0x7A80, 0xBA41,
+    0xBE01, 0x7EC0, 0x7F80, 0xBF41, 0x7D00, 0xBDC1, 0xBC81, 0x7C40,
+    0xB401, 0x74C0, 0x7580, 0xB541, 0x7700, 0xB7C1, 0xB681, 0x7640,
+    0x7200, 0xB2C1, 0xB381, 0x7340, 0xB101, 0x71C0, 0x7080, 0xB041,
+    0x5000, 0x90C1, 0x9181, 0x5140, 0x9301, 0x53C0, 0x5280, 0x9241,
+    0x9601, 0x56C0, 0x5780, 0x9741, 0x5500, 0x95C1, 0x9481, 0x5440,
+    0x9C01, 0x5CC0, 0x5D80, 0x9D41, 0x5F00, 0x9FC1, 0x9E81, 0x5E40,
+    0x5A00, 0x9AC1, 0x9B81, 0x5B40, 0x9901, 0x59C0, 0x5880, 0x9841,
+    0x8801, 0x48C0, 0x4980, 0x8941, 0x4B00, 0x8BC1, 0x8A81, 0x4A40,
+    0x4E00, 0x8EC1, 0x8F81, 0x4F40, 0x8D01, 0x4DC0, 0x4C80, 0x8C41,
+    0x4400, 0x84C1, 0x8581, 0x4540, 0x8701, 0x47C0, 0x4680, 0x8641,
+    0x8201, 0x42C0, 0x4380, 0x8341, 0x4100, 0x81C1, 0x8081, 0x4040,
+};
+
+// same result as _crc16_update()
+static inline uint16_t rf12_crcUpdate (uint16_t crc, uint8_t in) {
+    return (crc >> 8) ^ pgm_read_word(&crcTable[(uint8_t) (crc ^ in)]);
+}
+#else
+#define rf12_crcUpdate _crc16_update
+#endif
+
 /// @details
 /// This call provides direct access to the RFM12B registers. If you're careful
 /// to avoid configuring the wireless module in a way which stops the driver
@@ -284,29 +367,36 @@ uint16_t rf12_control(uint16_t cmd) {
     return r;
 }
 
+#if ISR_PROFILE
+static volatile uint8_t isrWorst;   // longest interrupt, in timer 0 ticks
+#endif
+
 static void rf12_interrupt () {
-    // a transfer of 2x 16 bits @ 2 MHz over SPI takes 2x 8 us inside this ISR
-    // correction: now takes 2 + 8 µs, since sending can be done at 8 MHz
-    rf12_xfer(0x0000); 
+#if ISR_PROFILE
+    uint8_t isrStart = TCNT0;
+#endif
 
     if (rxstate == TXRECV) {
-        uint8_t in = rf12_xferSlow(RF_RX_FIFO_READ);
+        // status and FIFO in one transfer, 16 bits @ 8 MHz and 8 @ 2 MHz
+        uint8_t in = rf12_statusFifo();
 
         if (rxfill == 0 && group != 0)
             rf12_buf[rxfill++] = group;
             
         rf12_buf[rxfill++] = in;
-        rf12_crc = _crc16_update(rf12_crc, in);
+        rf12_crc = rf12_crcUpdate(rf12_crc, in);
 
         if (rxfill >= rf12_len + 5 || rxfill >= RF_MAX)
             rf12_xfer(RF_IDLE_MODE);
     } else {
+        rf12_xfer(0x0000); // status, to clear the interrupt
+
         uint8_t out;
 
         if (rxstate < 0) {
             uint8_t pos = 3 + rf12_len + rxstate++;
             out = rf12_buf[pos];
-            rf12_crc = _crc16_update(rf12_crc, out);
+            rf12_crc = rf12_crcUpdate(rf12_crc, out);
         } else
             switch (rxstate++) {
                 case TXSYN1: out = 0x2D; break;
@@ -319,25 +409,43 @@ static void rf12_interrupt () {
             
         rf12_xfer(RF_TXREG_WRITE + out);
     }
+
+#if ISR_PROFILE
+    // timer 0 wraps every 256 ticks, far longer than the interrupt takes
+    uint8_t ticks = TCNT0 - isrStart;
+    if (ticks > isrWorst)
+        isrWorst = ticks;
+#endif
+}
+
+/// @details
+/// Returns the longest time spent in the interrupt handler since the last call,
+/// in processor cycles, and starts measuring again. It's timed with timer 0,
+/// which the Arduino core runs at clk/64, so it's to the nearest 64 cycles.
+/// Always 0 unless ISR_PROFILE is defined at the top of RF12.cpp.
+uint16_t rf12_isrCycles () {
+#if ISR_PROFILE
+    uint8_t ticks = isrWorst;
+    isrWorst = 0;
+    return ticks * 64;
+#else
+    return 0;
+#endif
 }
 
 #if PINCHG_IRQ
+    // the pin-change vectors are owned by the PinChange library so that other
+    // pins in the same bank can have handlers too
+    static void rf12_pinChange (uint8_t pins, uint8_t changed) {
     #if RFM_IRQ < 8
-        ISR(PCINT2_vect) {
-            while (!bitRead(PIND, RFM_IRQ))
-                rf12_interrupt();
-        }
+        while (!bitRead(PIND, RFM_IRQ))
     #elif RFM_IRQ < 14
-        ISR(PCINT0_vect) { 
-            while (!bitRead(PINB, RFM_IRQ - 8))
-                rf12_interrupt();
-        }
+        while (!bitRead(PINB, RFM_IRQ - 8))
     #else
-        ISR(PCINT1_vect) {
-            while (!bitRead(PINC, RFM_IRQ - 14))
-                rf12_interrupt();
-        }
+        while (!bitRead(PINC, RFM_IRQ - 14))
     #endif
+            rf12_interrupt();
+    }
 #endif
 
 static void rf12_recvStart () {
@@ -431,6 +539,14 @@ uint8_t rf12_canSend () {
     return 0;
 }
 
+/// @details
+/// Returns true while a packet is coming in, from its first byte after the sync
+/// word until rf12_recvDone() returns it. Unlike rf12_canSend() it leaves the
+/// receiver running, so it can be polled while waiting for a packet.
+uint8_t rf12_receiving () {
+    return rxstate == TXRECV && rxfill > 0;
+}
+
 void rf12_sendStart (uint8_t hdr) {
     rf12_hdr = hdr & RF12_HDR_DST ? hdr :
                 (hdr & ~RF12_HDR_MASK) + (nodeid & NODE_ID);
@@ -590,26 +706,23 @@ uint8_t rf12_initialize (uint8_t id, uint8_t band, uint8_t g, uint16_t f) {
         if ((nodeid & NODE_ID) != 0) {
             bitClear(DDRD, RFM_IRQ);      // input
             bitSet(PORTD, RFM_IRQ);       // pull-up
-            bitSet(PCMSK2, RFM_IRQ);      // pin-change
-            bitSet(PCICR, PCIE2);         // enable
+            PinChange::attach(RFM_IRQ, rf12_pinChange);
         } else
-            bitClear(PCMSK2, RFM_IRQ);
+            PinChange::detach(RFM_IRQ);
     #elif RFM_IRQ < 14
         if ((nodeid & NODE_ID) != 0) {
             bitClear(DDRB, RFM_IRQ - 8);  // input
             bitSet(PORTB, RFM_IRQ - 8);   // pull-up
-            bitSet(PCMSK0, RFM_IRQ - 8);  // pin-change
-            bitSet(PCICR, PCIE0);         // enable
+            PinChange::attach(RFM_IRQ, rf12_pinChange);
         } else
-            bitClear(PCMSK0, RFM_IRQ - 8);
+            PinChange::detach(RFM_IRQ);
     #else
         if ((nodeid & NODE_ID) != 0) {
             bitClear(DDRC, RFM_IRQ - 14); // input
             bitSet(PORTC, RFM_IRQ - 14);  // pull-up
-            bitSet(PCMSK1, RFM_IRQ - 14); // pin-change
-            bitSet(PCICR, PCIE1);         // enable
+            PinChange::attach(RFM_IRQ, rf12_pinChange);
         } else
-            bitClear(PCMSK1, RFM_IRQ - 14);
+            PinChange::detach(RFM_IRQ);
     #endif
 #else
     if ((nodeid & NODE_ID) != 0)
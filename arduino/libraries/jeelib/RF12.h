@@ -89,6 +89,9 @@ uint8_t rf12_recvDone(void);
 /// @return true when a new transmission may be started with rf12_sendStart().
 uint8_t rf12_canSend(void);
 
+/// Call this to check whether a packet is being received, without stopping it.
+uint8_t rf12_receiving(void);
+
 /// Call this only when rf12_recvDone() or rf12_canSend() return true.
 void rf12_sendStart(uint8_t hdr);
 /// Call this only when rf12_recvDone() or rf12_canSend() return true.
@@ -130,6 +133,9 @@ void rf12_setRawRecvMode(uint8_t fixed_pkt_len);
 /// http://tools.jeelabs.org/rfm12b is useful for calculating these.
 uint16_t rf12_control(uint16_t cmd);
 
+/// Longest time spent in the interrupt handler since the last call, in cycles.
+uint16_t rf12_isrCycles();
+
 /// See http://blog.strobotics.com.au/2009/07/27/rfm12-tutorial-part-3a/
 /// Transmissions are packetized, don't assume you can sustain these speeds! 
 ///
@@ -4,7 +4,10 @@
 
 #define REG_FIFO            0x00
 #define REG_OPMODE          0x01
+#define REG_BITRATEMSB      0x03
+#define REG_FDEVMSB         0x05
 #define REG_FRFMSB          0x07
+#define REG_RXBW            0x19
 #define REG_RSSIVALUE       0x24
 #define REG_DIOMAPPING1     0x25
 #define REG_IRQFLAGS1       0x27
@@ -12,6 +15,7 @@
 #define REG_SYNCCONFIG      0x2E
 #define REG_SYNCVALUE1      0x2F
 #define REG_SYNCVALUE2      0x30
+#define REG_PACKETCONFIG1   0x37
 #define REG_NODEADRS        0x39
 #define REG_PACKETCONFIG2   0x3D
 #define REG_AESKEY1         0x3E
@@ -23,12 +27,16 @@
 
 #define IRQ1_MODEREADY      0x80
 #define IRQ1_RXREADY        0x40
+#define IRQ1_SYNCADDRMATCH  0x01
 
 #define IRQ2_FIFOFULL       0x80
 #define IRQ2_FIFONOTEMPTY   0x40
 #define IRQ2_FIFOOVERRUN    0x10
 #define IRQ2_PACKETSENT     0x08
 #define IRQ2_PAYLOADREADY   0x04
+#define IRQ2_CRCOK          0x02
+
+#define BROADCAST_ADDR      0xFF
 
 #define RF_MAX   72
 
@@ -41,6 +49,7 @@ namespace RF69 {
     uint8_t  node;
     uint16_t crc;
     uint8_t  rssi;
+    bool     native;
 }
 
 static volatile uint8_t rxfill;     // number of data bytes in rf12_buf
@@ -72,6 +81,42 @@ static ROM_UINT8 configRegs_compat [] ROM_DATA = {
   0
 };
 
+// native mode, the same modulation as compatibility mode but the packet engine
+// handles the length byte, address and crc, so there's an interrupt at the
+// start of a packet for this node and one when it's all in the FIFO
+static ROM_UINT8 configRegs_native [] ROM_DATA = {
+  0x01, 0x04, // OpMode = standby
+  0x02, 0x00, // DataModul = packet mode, fsk
+  0x03, 0x02, // BitRateMsb, data rate = 49,261 khz
+  0x04, 0x8A, // BitRateLsb, divider = 32 MHz / 650
+  0x05, 0x05, // FdevMsb = 90 KHz
+  0x06, 0xC3, // FdevLsb = 90 KHz
+  0x0B, 0x20, // AfcCtrl, afclowbetaon
+  0x19, 0x42, // RxBw ...
+  0x1E, 0x2C, // FeiStart, AfcAutoclearOn, AfcAutoOn
+  0x25, 0x80, // DioMapping1 = SyncAddress (Rx)
+  0x2E, 0x88, // SyncConfig = sync on, sync size = 2
+  0x2F, 0x2D, // SyncValue1 = 0x2D
+  0x37, 0xDC, // PacketConfig1 = variable, white, crc, keep bad crc, node/bcast
+  0x38, RF69_NATIVE_MAXDATA + 2, // PayloadLength = max, address + hdr + data
+  0x3A, BROADCAST_ADDR, // BroadcastAdrs
+  0x3C, 0x8F, // FifoTresh, not empty, level 15
+  0x3D, 0x12, // PacketConfig2, interpkt = 1, autorxrestart on
+  0x6F, 0x20, // TestDagc ...
+  0
+};
+
+// changes to the above for the fast option, twice the data rate and
+// deviation, and twice the receive bandwidth to go with them
+static ROM_UINT8 configRegs_fast [] ROM_DATA = {
+  0x03, 0x01, // BitRateMsb, data rate = 100 khz
+  0x04, 0x40, // BitRateLsb, divider = 32 MHz / 320
+  0x05, 0x0B, // FdevMsb = 180 KHz
+  0x06, 0x85, // FdevLsb = 180 KHz
+  0x19, 0x41, // RxBw ...
+  0
+};
+
 uint8_t RF69::control(uint8_t cmd, uint8_t val) {
     PreventInterrupt irq0;
     return spiTransfer(cmd, val);
@@ -85,6 +130,25 @@ static uint8_t readReg (uint8_t addr) {
     return RF69::control(addr, 0);
 }
 
+// burst access to the FIFO, one SPI select for the lot
+static void readFifo (uint8_t* buf, uint8_t len) {
+    PreventInterrupt irq0;
+    SS_PORT &= ~ _BV(SS_BIT);
+    spiTransferByte(REG_FIFO);
+    while (len--)
+        *buf++ = spiTransferByte(0);
+    SS_PORT |= _BV(SS_BIT);
+}
+
+static void writeFifo (const uint8_t* buf, uint8_t len) {
+    PreventInterrupt irq0;
+    SS_PORT &= ~ _BV(SS_BIT);
+    spiTransferByte(REG_FIFO | 0x80);
+    while (len--)
+        spiTransferByte(*buf++);
+    SS_PORT |= _BV(SS_BIT);
+}
+
 static void flushFifo () {
     while (readReg(REG_IRQFLAGS2) & (IRQ2_FIFONOTEMPTY | IRQ2_FIFOOVERRUN))
         readReg(REG_FIFO);
@@ -96,6 +160,15 @@ static void setMode (uint8_t mode) {
     //     ;
 }
 
+static void writeRegs (ROM_UINT8* regs) {
+    for (;;) {
+        uint8_t cmd = ROM_READ_UINT8(regs);
+        if (cmd == 0) break;
+        writeReg(cmd, ROM_READ_UINT8(regs+1));
+        regs += 2;
+    }
+}
+
 static void initRadio (ROM_UINT8* init) {
     spiInit();
     do
@@ -104,12 +177,7 @@ static void initRadio (ROM_UINT8* init) {
     do
         writeReg(REG_SYNCVALUE1, 0x55);
     while (readReg(REG_SYNCVALUE1) != 0x55);
-    for (;;) {
-        uint8_t cmd = ROM_READ_UINT8(init);
-        if (cmd == 0) break;
-        writeReg(cmd, ROM_READ_UINT8(init+1));
-        init += 2;
-    }
+    writeRegs(init);
 }
 
 void RF69::setFrequency (uint32_t freq) {
@@ -122,7 +190,10 @@ void RF69::setFrequency (uint32_t freq) {
 }
 
 bool RF69::canSend () {
-    if (rxstate == TXRECV && rxfill == 0) {
+    // in native mode rxfill stays 0 until the packet's complete, so check
+    // that one isn't on its way in
+    if (rxstate == TXRECV && rxfill == 0 &&
+            !(native && (readReg(REG_IRQFLAGS1) & IRQ1_SYNCADDRMATCH))) {
         rxstate = TXIDLE;
         setMode(MODE_STANDBY);
         return true;
@@ -130,6 +201,11 @@ bool RF69::canSend () {
     return false;
 }
 
+bool RF69::receiving () {
+    return rxstate == TXRECV && (rxfill > 0 ||
+            (native && (readReg(REG_IRQFLAGS1) & IRQ1_SYNCADDRMATCH)));
+}
+
 bool RF69::sending () {
     return rxstate < TXIDLE;
 }
@@ -153,6 +229,7 @@ void RF69::configure_compat () {
     writeReg(REG_FRFMSB+1, frf >> 8);
     writeReg(REG_FRFMSB+2, frf);
 
+    native = false;
     rxstate = TXIDLE;
 }
 
@@ -234,3 +311,92 @@ void RF69::interrupt_compat () {
         writeReg(REG_DIOMAPPING1, 0x80); // SyncAddress
     }
 }
+
+void RF69::configure_native (bool fast) {
+    initRadio(configRegs_native);
+    if (fast)
+        writeRegs(configRegs_fast);
+    writeReg(REG_SYNCVALUE2, group);
+
+    writeReg(REG_FRFMSB, frf >> 16);
+    writeReg(REG_FRFMSB+1, frf >> 8);
+    writeReg(REG_FRFMSB+2, frf);
+
+    // node 31 hears everything, as with the RFM12
+    writeReg(REG_NODEADRS, node);
+    if (node == 31)
+        writeReg(REG_PACKETCONFIG1, 0xD8); // address filtering off
+
+    native = true;
+    rxstate = TXIDLE;
+}
+
+uint16_t RF69::recvDone_native (uint8_t* buf) {
+    switch (rxstate) {
+    case TXIDLE:
+        rxfill = 0;
+        recvBuf = buf;
+        rxstate = TXRECV;
+        writeReg(REG_IRQFLAGS2, IRQ2_FIFOOVERRUN); // clears the FIFO
+        writeReg(REG_DIOMAPPING1, 0x80); // SyncAddress
+        setMode(MODE_RECEIVER);
+        break;
+    case TXRECV:
+        // the interrupt has already read the packet and put the radio in standby
+        if (rxfill) {
+            rxstate = TXIDLE;
+            return crc;
+        }
+    }
+    return ~0;
+}
+
+// the packet on air is the length, the address (destination node if DST is
+// set, else broadcast), the RF12 header byte and the data
+void RF69::sendStart_native (uint8_t hdr, const void* ptr, uint8_t len) {
+    if (len > RF69_NATIVE_MAXDATA)
+        len = RF69_NATIVE_MAXDATA;
+    hdr = hdr & RF12_HDR_DST ? hdr : (hdr & ~RF12_HDR_MASK) + node;
+    uint8_t head[3];
+    head[0] = len + 2;
+    head[1] = hdr & RF12_HDR_DST ? hdr & RF12_HDR_MASK : BROADCAST_ADDR;
+    head[2] = hdr;
+
+    rxstate = TXDONE;
+    writeReg(REG_IRQFLAGS2, IRQ2_FIFOOVERRUN); // clears the FIFO
+    writeFifo(head, sizeof head);
+    writeFifo((const uint8_t*) ptr, len);
+    writeReg(REG_DIOMAPPING1, 0x00); // PacketSent
+    setMode(MODE_TRANSMITTER);
+}
+
+void RF69::interrupt_native () {
+    if (rxstate == TXRECV) {
+        uint8_t flags = readReg(REG_IRQFLAGS2);
+        if (flags & IRQ2_PAYLOADREADY) {
+            setMode(MODE_STANDBY);
+            uint8_t head[3];
+            readFifo(head, sizeof head);
+            uint8_t len = head[0] - 2;
+            if (head[0] < 2 || len > RF69_NATIVE_MAXDATA) {
+                len = 0;
+                flags &= ~IRQ2_CRCOK; // force bad crc for invalid packet
+            }
+            recvBuf[0] = group;
+            recvBuf[1] = head[2];
+            recvBuf[2] = len;
+            readFifo(recvBuf + 3, len);
+            crc = flags & IRQ2_CRCOK ? 0 : 1;
+            rxfill = len + 3;
+            writeReg(REG_DIOMAPPING1, 0x80); // SyncAddress, for the next one
+        } else {
+            // sync and address matched, take the rssi while the packet's
+            // coming in and wait for the rest of it
+            rssi = readReg(REG_RSSIVALUE);
+            writeReg(REG_DIOMAPPING1, 0x40); // PayloadReady
+        }
+    } else if (readReg(REG_IRQFLAGS2) & IRQ2_PACKETSENT) {
+        rxstate = TXIDLE;
+        setMode(MODE_STANDBY);
+    }
+}
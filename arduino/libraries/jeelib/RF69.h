@@ -1,15 +1,21 @@
 #ifndef RF69_h
 #define RF69_h
 
+/// Largest payload in native mode. The whole packet, with its length, address
+/// and header bytes, has to fit in the RFM69's 66 byte FIFO.
+#define RF69_NATIVE_MAXDATA 63
+
 namespace RF69 {
     extern uint32_t frf;
     extern uint8_t  group;
     extern uint8_t  node;
     extern uint8_t  rssi;
+    extern bool     native;
 
     void setFrequency (uint32_t freq);
     bool canSend ();
     bool sending ();
+    bool receiving ();
     void sleep (bool off);
     uint8_t control(uint8_t cmd, uint8_t val);
     
@@ -17,6 +23,11 @@ namespace RF69 {
     uint16_t recvDone_compat (uint8_t* buf);
     void sendStart_compat (uint8_t hdr, const void* ptr, uint8_t len);
     void interrupt_compat();
+
+    void configure_native (bool fast);
+    uint16_t recvDone_native (uint8_t* buf);
+    void sendStart_native (uint8_t hdr, const void* ptr, uint8_t len);
+    void interrupt_native();
 }
 
 #endif
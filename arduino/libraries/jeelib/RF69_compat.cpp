@@ -8,6 +8,11 @@ volatile uint8_t rf69_buf[72];
 
 static byte nodeid; // only used in the easyPoll code
 
+// the band's base frequency and the size of a step of the RF12's frequency
+// word, for rf69_control
+static uint32_t bandBase;
+static uint16_t bandStep;
+
 // same as in RF12
 #define RETRIES     8               // stop retrying after 8 times
 #define RETRY_MS    1000            // resend packet every second until ack'ed
@@ -25,25 +30,45 @@ static long ezNextSend[2];          // when was last retry [0] or data [1] sent
 // void rf69_spiInit () {
 // }
 
-uint8_t rf69_initialize (uint8_t id, uint8_t band, uint8_t group, uint16_t off) {
+// mode is 0 for compatibility mode, 1 for native and 2 for native at the fast rate
+static uint8_t initialize (uint8_t id, uint8_t band, uint8_t group, uint16_t off,
+                            uint8_t mode) {
     uint8_t freq = 0;
     switch (band) {
         case RF12_433MHZ: freq = 43; break;
         case RF12_868MHZ: freq = 86; break;
         case RF12_915MHZ: freq = 90; break;
     }
-    RF69::setFrequency(freq * 10000000L + band * 2500L * off);
+    bandBase = freq * 10000000L;
+    bandStep = band * 2500;
+    RF69::setFrequency(bandBase + (uint32_t) bandStep * off);
     RF69::group = group;
     RF69::node = id & RF12_HDR_MASK;
     delay(20); // needed to make RFM69 work properly on power-up
     if (RF69::node != 0)
-        attachInterrupt(0, RF69::interrupt_compat, RISING);
+        attachInterrupt(0, mode ? RF69::interrupt_native : RF69::interrupt_compat,
+                        RISING);
     else
         detachInterrupt(0);
-    RF69::configure_compat();
+    if (mode)
+        RF69::configure_native(mode == 2);
+    else
+        RF69::configure_compat();
     return nodeid = id;
 }
 
+uint8_t rf69_initialize (uint8_t id, uint8_t band, uint8_t group, uint16_t off) {
+    return initialize(id, band, group, off, 0);
+}
+
+uint8_t rf69_initializeNative (uint8_t id, uint8_t band, uint8_t group, uint16_t off) {
+    return initialize(id, band, group, off, 1);
+}
+
+uint8_t rf69_initializeFast (uint8_t id, uint8_t band, uint8_t group, uint16_t off) {
+    return initialize(id, band, group, off, 2);
+}
+
 // same code as rf12_config(Silent), just calling rf69_initialize() instead
 uint8_t rf69_configSilent () {
     uint16_t crc = ~0;
@@ -74,7 +99,8 @@ uint8_t rf69_config (uint8_t show) {
 }
 
 uint8_t rf69_recvDone () {
-    rf69_crc = RF69::recvDone_compat((uint8_t*) rf69_buf);
+    rf69_crc = RF69::native ? RF69::recvDone_native((uint8_t*) rf69_buf)
+                            : RF69::recvDone_compat((uint8_t*) rf69_buf);
     return rf69_crc != ~0;
 }
 
@@ -82,11 +108,18 @@ uint8_t rf69_canSend () {
     return RF69::canSend();
 }
 
+uint8_t rf69_receiving () {
+    return RF69::receiving();
+}
+
 // void rf69_sendStart (uint8_t hdr) {
 // }
 
 void rf69_sendStart (uint8_t hdr, const void* ptr, uint8_t len) {
-    RF69::sendStart_compat(hdr, ptr, len);
+    if (RF69::native)
+        RF69::sendStart_native(hdr, ptr, len);
+    else
+        RF69::sendStart_compat(hdr, ptr, len);
 }
 
 // void rf69_sendStart (uint8_t hdr, const void* ptr, uint8_t len, uint8_t sync) {
@@ -117,8 +150,10 @@ void rf69_sleep (char n) {
     RF69::sleep(n == RF12_SLEEP);
 }
 
-// char rf69_lowbat () {
-// }
+// the RFM69 has no low battery detector
+char rf69_lowbat () {
+    return 0;
+}
 
 // same as in RF12
 void rf69_easyInit (uint8_t secs) {
@@ -169,5 +204,39 @@ char rf69_easySend (const void* data, uint8_t size) {
 // void rf69_encrypt (const uint8_t*) {
 // }
 
-// uint16_t rf69_control (uint16_t cmd) {
-// }
+// only some RFM12 commands are supported:
+//  0x98xx  transmit power, its 8 steps of 2.5 dB below full power are mapped onto
+//          the RFM69's PaLevel register
+//  0xAxxx  frequency, which takes effect the next time the receiver's turned on,
+//          e.g. after rf69_sleep(RF12_WAKEUP)
+//  0x0000  status, with only the RSSI bit (0x0100), set while the receiver hears
+//          a signal above -91 dBm like the RFM12's default threshold
+//  0xC6xx  data rate, without the prescaler (0xC680), mapped onto the BitRate
+//          divider, 32 MHz * 29 * (R + 1) / 10 MHz
+//  0x94xx  receive bandwidth, only its 134, 200 and 270 kHz settings, mapped onto
+//          the RxBw register
+uint16_t rf69_control (uint16_t cmd) {
+    if ((cmd & 0xFF00) == 0x9800)
+        RF69::control(0x11 | 0x80, 0x80 | (31 - (cmd & 7) * 5 / 2));
+    else if ((cmd & 0xFF80) == 0xC600) {
+        uint16_t divider = (928L * ((cmd & 0x7F) + 1) + 5) / 10;
+        RF69::control(0x03 | 0x80, divider >> 8);
+        RF69::control(0x04 | 0x80, divider);
+    }
+    else if ((cmd & 0xFF00) == 0x9400) {
+        switch ((cmd >> 5) & 7) {
+            case 5: RF69::control(0x19 | 0x80, 0x42); break; // 125 kHz
+            case 4: RF69::control(0x19 | 0x80, 0x49); break; // 200 kHz
+            case 3: RF69::control(0x19 | 0x80, 0x41); break; // 250 kHz
+        }
+    }
+    else if ((cmd & 0xF000) == 0xA000) {
+        RF69::setFrequency(bandBase + (uint32_t) bandStep * (cmd & 0x0FFF));
+        RF69::control(0x07 | 0x80, RF69::frf >> 16);
+        RF69::control(0x08 | 0x80, RF69::frf >> 8);
+        RF69::control(0x09 | 0x80, RF69::frf);
+    }
+    else if (cmd == 0x0000)
+        return RF69::control(0x24, 0) < 182 ? 0x0100 : 0; // RssiValue, -dBm * 2
+    return 0;
+}
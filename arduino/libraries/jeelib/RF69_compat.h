@@ -1,6 +1,14 @@
 // Include this file instead of RF12.h to use a RFM69 wireless radio module
 // in compatibility mode, i.e. as if it were an RFM12, or insert this line
 // before including the <JeeLib.h> header in your code: #define RF69_COMPAT 1
+//
+// Define RF69_NATIVE as 1 as well to use the RFM69's own packet format with the
+// same rf12_* calls. The packet engine adds the length byte, crc and address and
+// filters out packets for other nodes, so both the radio and the processor are
+// busy for far less time per packet. Every radio in the group must use it, as
+// RFM12s and RFM69s in compatibility mode can't receive its packets. Payloads
+// are limited to RF69_NATIVE_MAXDATA bytes. RF69_NATIVE_FAST also doubles the
+// data rate, for a shorter time on air at the cost of some range.
 
 #ifndef RF69_compat_h
 #define RF69_compat_h
@@ -15,11 +23,18 @@
                             
 #define rf12_set_cs         rf69_set_cs
 #define rf12_spiInit        rf69_spiInit
+#if RF69_NATIVE_FAST
+#define rf12_initialize     rf69_initializeFast
+#elif RF69_NATIVE
+#define rf12_initialize     rf69_initializeNative
+#else
 #define rf12_initialize     rf69_initialize
+#endif
 #define rf12_config         rf69_config
 #define rf12_configSilent   rf69_configSilent
 #define rf12_recvDone       rf69_recvDone
 #define rf12_canSend        rf69_canSend
+#define rf12_receiving      rf69_receiving
 #define rf12_sendStart      rf69_sendStart
 #define rf12_sendNow        rf69_sendNow
 #define rf12_sendWait       rf69_sendWait
@@ -11,6 +11,21 @@ config.serialport = "/dev/ttyUSB0";
 // baud rate for connecting to JeeNode - default 9600
 config.baudrate = 9600;
 
+// To use more than one receiver, list them here instead. Secondary receivers have
+// acknowledgements turned off. Each packet is passed on once, from the receiver that
+// heard it best. The name shows which receivers heard each node.
+//config.receivers = [
+//	{ name: "main", serialport: "/dev/ttyUSB0", baudrate: 9600 },
+//	{ name: "hall", serialport: "/dev/ttyUSB1", baudrate: 9600 }
+//];
+
+// how long to wait for the other receivers' copies of a packet, and how long a packet
+// is remembered so later copies are dropped (must be under 80 seconds)
+config.merge_settings = {
+	hold_ms: 1000,
+	window_ms: 20000
+};
+
 // name of publisher module to load for publishing readings to an external logging service
 config.publisher = "emoncms";
 
@@ -27,21 +27,25 @@ const sensorTypes = {
 	2: { name: "humidity",    min: 0, max: 100 },
 	3: { name: "light",       min: 0, max: 255 },
 	4: { name: "movement",    min: 0, max: 0 },
-	5: { name: "pressure",    min: 0, max: 0 },
+	5: { name: "pressure",    min: 850, max: 1100 },
 	6: { name: "sound",       min: 0, max: 0 },
 	7: { name: "lowbatt",     min: 0, max: 0 }
 };
 
 const	serverUrlTemplate = "http://$server/input/post.json?node=$node&json=$json&apikey=$key";
 
-const publish = function(nodeid, readings) {
+// time {Number}: when the readings were taken, in ms since the epoch
+const publish = function(nodeid, readings, time) {
 
 	const json = formatJson(readings);
 
-	const url = this.urlTemplate
+	let url = this.urlTemplate
 				.replace("$node", this.nodeid_offset + nodeid)
 				.replace("$json", JSON.stringify(json));
 
+	// emoncms takes the time in seconds
+	if (time) url += "&time=" + Math.round(time / 1000);
+
 	fetch(url)
 	.then(response => {
 	  if (!response.ok) {
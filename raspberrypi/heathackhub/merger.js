@@ -0,0 +1,76 @@
+///////////////////////////
+// merges the packets reported by several receivers
+//
+// A packet heard by more than one receiver is reported by each of them. The copies
+// are matched on node id and sequence number. The first copy is held for hold_ms
+// while the others come in, then the one with the best signal is passed on along
+// with the names of the receivers that heard it. Copies that turn up later, within
+// window_ms of the first, are dropped.
+//
+// The sequence number is only 3 bits, so window_ms must be shorter than 8 times the
+// shortest transmit interval (10 seconds).
+//
+// hold_ms {Number}: how long to wait for other receivers' copies
+// window_ms {Number}: how long a node id and sequence number are remembered
+
+
+// constructor
+// onPacket {Function}: called with the best copy of each packet and the receivers that heard it
+const constructor = function(config, onPacket) {
+	this.holdMs = config.hold_ms || 1000;
+	this.windowMs = config.window_ms || 20000;
+	this.onPacket = onPacket;
+
+	// packets seen in the last window_ms, by "<node id>:<sequence>"
+	this.recent = {};
+};
+
+// packet {Object}: from a receiver, with nodeid, receiver and optionally seq and rssi
+const add = function(packet) {
+
+	// a receiver without sequence numbers can't be merged
+	if (packet.seq === undefined) {
+		this.onPacket(packet, [packet.receiver]);
+		return;
+	}
+
+	const now = Date.now();
+	this.expire(now);
+
+	const key = packet.nodeid + ":" + packet.seq;
+	const entry = this.recent[key];
+
+	if (entry) {
+		if (entry.heardBy.indexOf(packet.receiver) < 0) entry.heardBy.push(packet.receiver);
+		if (!entry.passedOn && betterSignal(packet, entry.best)) entry.best = packet;
+		return;
+	}
+
+	const newEntry = { firstHeard: now, best: packet, heardBy: [packet.receiver], passedOn: false };
+	this.recent[key] = newEntry;
+
+	setTimeout(() => {
+		newEntry.passedOn = true;
+		this.onPacket(newEntry.best, newEntry.heardBy);
+	}, this.holdMs);
+};
+
+// forget packets older than the window
+const expire = function(now) {
+	for (let key in this.recent) {
+		if (now - this.recent[key].firstHeard > this.windowMs) delete this.recent[key];
+	}
+};
+
+// true if copy a of a packet was received with a stronger signal than copy b.
+// A copy without a signal strength counts as the weakest.
+const betterSignal = function(a, b) {
+	if (a.rssi === undefined) return false;
+	if (b.rssi === undefined) return true;
+	return a.rssi > b.rssi;
+};
+
+
+exports.Merger = constructor;
+constructor.prototype.add = add;
+constructor.prototype.expire = expire;
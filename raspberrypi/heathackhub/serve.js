@@ -2,6 +2,7 @@ const SerialPort = require("serialport");
 const Readline = SerialPort.parsers.Readline;
 const express = require("express");
 const config = require("./config");
+const Merger = require("./merger").Merger;
 
 // load configured publisher
 const publishAPI = require('./' + config.publisher);
@@ -23,6 +24,22 @@ const nodeData = {
 };
 
 
+// get the node object, creating it if it's new
+const getNode = function(nodeid) {
+	let node = nodeData.nodes[nodeid];
+
+	if (!node) {
+		node = {};
+		node.id = nodeid;
+		node.sensors = {};
+		node.receivers = {};
+		nodeData.nodes[nodeid] = node;
+	}
+
+	return node;
+};
+
+
 ///////////////////////////
 // web server
 
@@ -42,53 +59,25 @@ app.listen(80);
 
 
 ///////////////////////////
-// serial listener
-
-// JeeLink on USB0 at 9600 baud default
-const serial = new SerialPort(config.serialport || "/dev/ttyUSB0", {baudRate: config.baudrate || 9600});
-
-const parser = serial.pipe(new Readline());
-
-serial.on("error", function(e) {
-	console.log("Serial port: " + e);
-	process.exit(1);
-});
-
-// event handler for an input string from the serial port
-parser.on("data", function(data) {
-
-	// split string into tokens
-	const tokens = data.toString().split(" ");
+// merging of packets from several receivers
 
-	// if first token (word) isn't "heathack", it's not valid data
-	if (tokens[0] !== "heathack") return;
-
-	// next token is node id
-	const nodeid = tokens[1];
+const merger = new Merger(config.merge_settings || {}, function(packet, heardBy) {
 
 	// get the relevant node object
-	let node = nodeData.nodes[nodeid];
+	const node = getNode(packet.nodeid);
 
-	// if it doesn't exist, create a new one
-	if (!node) {
-		node = {};
-		node.id = nodeid;
-		node.sensors = {};
-		nodeData.nodes[nodeid] = node;
-	}
-
-	node.lastReadingTime = Date.now();
+	node.lastReadingTime = packet.time;
 
 	// rest of tokens are tuples of sensor id, type and value
 
 	// data to publish to emoncms
 	const curReadings = [];
 
-	for (let i=2; i<tokens.length - 2; i+=3) {
+	for (let i=packet.first; i<packet.tokens.length - 2; i+=3) {
 
-		const sensorid = tokens[i];
-		const type = tokens[i+1];
-		const value = tokens[i+2];
+		const sensorid = packet.tokens[i];
+		const type = packet.tokens[i+1];
+		const value = packet.tokens[i+2];
 
 		curReadings.push( {id: sensorid, type: type, value: value} );
 
@@ -114,10 +103,98 @@ parser.on("data", function(data) {
 	}
 
 	if (config.verbose) {
-		console.log("Node " + nodeid + ":");
+		console.log("Node " + packet.nodeid + " (heard by " + heardBy.join(", ") + "):");
 		console.log(curReadings);
 	}
 
 	// publish to EmonCMS
-	publisher.publish(nodeid, curReadings);
+	publisher.publish(packet.nodeid, curReadings, packet.time);
 });
+
+
+///////////////////////////
+// serial listeners
+
+// JeeLink on USB0 at 9600 baud default. config.receivers lists several receivers.
+const receivers = config.receivers ||
+	[ { name: "main", serialport: config.serialport || "/dev/ttyUSB0", baudrate: config.baudrate } ];
+
+for (let receiver of receivers) {
+	const serial = new SerialPort(receiver.serialport, {baudRate: receiver.baudrate || 9600});
+
+	const parser = serial.pipe(new Readline());
+
+	serial.on("error", function(e) {
+		console.log("Serial port " + receiver.serialport + ": " + e);
+		process.exit(1);
+	});
+
+	parser.on("data", function(data) {
+		readLine(receiver.name || receiver.serialport, data);
+	});
+}
+
+// handle an input string from a receiver's serial port
+const readLine = function(receiverName, data) {
+
+	// split string into tokens
+	const tokens = data.toString().split(" ");
+
+	// if first token (word) isn't "heathack", it's not valid data
+	if (tokens[0] !== "heathack") return;
+
+	// next token is node id
+	const packet = { nodeid: tokens[1], receiver: receiverName, tokens: tokens, first: 2 };
+
+	// then optional "#<sequence>", "~<signal strength in dBm>", "!<packets lost before
+	// this one>" and "@<secs>", which says how long ago the node took the readings.
+	// Without it they're taken to be from now.
+	let age = 0;
+	packet.lost = 0;
+
+	for (; packet.first < tokens.length; packet.first++) {
+		const token = tokens[packet.first];
+
+		if (token[0] === "#") packet.seq = parseInt(token.substring(1));
+		else if (token[0] === "~") packet.rssi = parseInt(token.substring(1));
+		else if (token[0] === "!") packet.lost = parseInt(token.substring(1)) || 0;
+		else if (token[0] === "@") age = parseInt(token.substring(1)) || 0;
+		else break;
+	}
+
+	packet.time = Date.now() - age * 1000;
+
+	countLink(packet);
+	merger.add(packet);
+};
+
+// add a packet to the statistics for the link between its node and the receiver
+// that heard it: packets received and lost, the last signal strength and the
+// jitter in ms, the smoothed difference between successive intervals as for RTP
+// (RFC 3550). The receiver has no room to keep these for every node.
+const countLink = function(packet) {
+	const node = getNode(packet.nodeid);
+	let link = node.receivers[packet.receiver];
+	const now = Date.now();
+
+	if (!link) {
+		link = {};
+		link.packets = 0;
+		link.lost = 0;
+		link.jitter = 0;
+		node.receivers[packet.receiver] = link;
+	}
+	else {
+		const interval = now - link.lastArrival;
+		if (link.lastInterval !== undefined) {
+			link.jitter += (Math.abs(interval - link.lastInterval) - link.jitter) / 16;
+		}
+		link.lastInterval = interval;
+	}
+
+	link.packets++;
+	link.lost += packet.lost;
+	link.lastArrival = now;
+	link.lastHeard = packet.time;
+	if (packet.rssi !== undefined) link.rssi = packet.rssi;
+};
@@ -0,0 +1,80 @@
+// Decodes the event trace printed by a node's config console or by the receiver
+// (see arduino/libraries/HeatHack/HeatHackTrace.h) back into source locations.
+//
+// usage: node trace-decode.js [log file] [sketch file]
+//
+// Reads lines starting "trace" from the log file, or stdin if there isn't one, and
+// prints each event with the time since the previous one, where it was recorded and
+// the line of code that recorded it. Other lines are ignored, so the receiver's
+// whole output can be fed in.
+
+const fs = require("fs");
+const path = require("path");
+const readline = require("readline");
+
+const libDir = path.join(__dirname, "..", "..", "arduino", "libraries", "HeatHack");
+
+// same order as the TRACE_xxx file numbers in HeatHackTrace.h
+const files = [
+	process.argv[3] || null,
+	path.join(libDir, "HeatHackShared.h"),
+	path.join(libDir, "HeatHackSensors.h"),
+	path.join(libDir, "HeatHackRoomBoard.h")
+];
+
+// source lines of each file, loaded when first needed
+const sources = {};
+
+function sourceLine(file, line) {
+	if (!file) return "";
+
+	if (sources[file] === undefined) {
+		try {
+			sources[file] = fs.readFileSync(file, "utf8").split(/\r?\n/);
+		}
+		catch (e) {
+			sources[file] = null;
+		}
+	}
+
+	return (sources[file] && sources[file][line - 1] || "").trim();
+}
+
+// last event time seen for each node, to show the time between events
+const lastTime = {};
+
+function decode(line) {
+	const tokens = line.trim().split(" ");
+
+	if (tokens[0] !== "trace") return;
+
+	const node = tokens[1];
+
+	for (let i = 2; i < tokens.length; i++) {
+		const parts = tokens[i].split(":");
+		if (parts.length !== 3) continue;
+
+		const id = parseInt(parts[0], 16);
+		const value = parseInt(parts[1], 16);
+		const time = parseInt(parts[2], 16);
+
+		const fileNum = id >> 12;
+		const lineNum = id & 0x0FFF;
+		const file = files[fileNum];
+		const name = file ? path.basename(file) : "file" + fileNum;
+
+		// the times are the low 16 bits of millis() so allow for them wrapping
+		let delta = "";
+		if (lastTime[node] !== undefined) {
+			delta = "+" + ((time - lastTime[node]) & 0xFFFF) + "ms";
+		}
+		lastTime[node] = time;
+
+		console.log("node " + node + " " + time + "ms " + delta + " " + name + ":" + lineNum +
+			" value " + value + " (0x" + value.toString(16) + ")  " + sourceLine(file, lineNum));
+	}
+}
+
+const input = process.argv[2] ? fs.createReadStream(process.argv[2]) : process.stdin;
+
+readline.createInterface({ input: input }).on("line", decode);